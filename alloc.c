@@ -0,0 +1,301 @@
+/*
+ * alloc.c - the allocators that mdriver can evaluate
+ *
+ * See alloc.h. mm takes its memory from memlib, which is reset at the
+ * start of every run.
+ *
+ * Two of them are references rather than allocators one would use,
+ * and bound what mm.c can reach on this machine:
+ *   - bump hands out blocks from the end of a chunk and never reuses
+ *     one, so no allocator does less work per request (the throughput
+ *     bound). It maps its chunks itself and keeps them between runs,
+ *     as a fresh memlib heap would have it fault in every page;
+ *   - oracle claims a heap of just the live bytes, rounded up to
+ *     whole pages, so no allocator wastes less (the utilization
+ *     bound). Its blocks come from the C library; only its heap size
+ *     is ideal.
+ * Both keep the requested size in a header in front of each block.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#include "alloc.h"
+#include "mm.h"
+#include "memlib.h"
+
+/*
+ * mm_alloc_init - Start the mm package on an empty memlib heap
+ */
+static int mm_alloc_init(void)
+{
+    mem_reset();
+    mem_reset_stats();
+    return mm_init();
+}
+
+/*
+ * memlib_stats - Report the memlib heap of an allocator
+ */
+static void memlib_stats(alloc_stats_t *st)
+{
+    st->heap = mem_heapsize();
+    st->mappings = mem_mappings();
+    mem_get_stats(&st->mem);
+}
+
+/*
+ * libc_init - The C library's allocator needs no setup
+ */
+static int libc_init(void)
+{
+    return 0;
+}
+
+/* Header in front of each bump and oracle block; keeps 16-byte alignment */
+typedef struct {
+    size_t size;        /* bytes requested */
+    size_t pad;
+} ref_header_t;
+
+#define REF_HEADER(p) ((ref_header_t *)(p) - 1)
+#define REF_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+#define BUMP_CHUNK (1 << 20)    /* bytes mapped at a time */
+
+/* Header of a chunk; its size keeps the blocks 16-byte aligned */
+typedef struct bump_chunk {
+    struct bump_chunk *next;
+    size_t len;         /* bytes mapped, with this header */
+    size_t pad[2];
+} bump_chunk_t;
+
+static bump_chunk_t *bump_first;    /* every chunk ever mapped */
+static bump_chunk_t *bump_cur;      /* the chunk being carved */
+static char *bump_next;             /* its next free byte */
+static char *bump_end;              /* its end */
+static char *bump_last;             /* the last block handed out */
+static size_t bump_heap;            /* bytes of the chunks used since init */
+static long bump_chunks;            /* chunks used since init */
+
+/*
+ * bump_init - Start again at the first chunk. The chunks stay mapped
+ *     from one run to the next, so that a run pays for its requests
+ *     rather than for faulting in fresh pages.
+ */
+static int bump_init(void)
+{
+    bump_cur = NULL;
+    bump_next = bump_end = bump_last = NULL;
+    bump_heap = 0;
+    bump_chunks = 0;
+    return 0;
+}
+
+/*
+ * bump_malloc - Carve the block from the current chunk, moving on to
+ *     the next one when it does not fit. A chunk is mapped when no
+ *     later one is big enough; a block bigger than BUMP_CHUNK gets a
+ *     chunk of its own.
+ */
+static void *bump_malloc(size_t size)
+{
+    size_t need = REF_ALIGN(size) + sizeof(ref_header_t);
+    size_t len;
+    bump_chunk_t *c;
+    char *p;
+
+    if (need > (size_t)(bump_end - bump_next)) {
+	c = bump_cur ? bump_cur->next : bump_first;
+	if (c == NULL || c->len - sizeof(bump_chunk_t) < need) {
+	    len = (need + sizeof(bump_chunk_t) + BUMP_CHUNK - 1)
+		& ~(size_t)(BUMP_CHUNK - 1);
+	    c = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	    if (c == MAP_FAILED)
+		return NULL;
+	    c->len = len;
+	    if (bump_cur) {
+		c->next = bump_cur->next;
+		bump_cur->next = c;
+	    }
+	    else {
+		c->next = bump_first;
+		bump_first = c;
+	    }
+	}
+	bump_cur = c;
+	bump_next = (char *)(c + 1);
+	bump_end = (char *)c + c->len;
+	bump_heap += c->len;
+	bump_chunks++;
+    }
+    p = bump_next + sizeof(ref_header_t);
+    bump_next += need;
+    REF_HEADER(p)->size = size;
+    bump_last = p;
+    return p;
+}
+
+/*
+ * bump_free - Blocks are never reused
+ */
+static void bump_free(void *ptr)
+{
+}
+
+/*
+ * bump_realloc - Grow or shrink the last block in place if its chunk
+ *     has room, otherwise copy to a new block
+ */
+static void *bump_realloc(void *ptr, size_t size)
+{
+    size_t old;
+    char *p;
+
+    if (ptr == NULL)
+	return bump_malloc(size);
+    old = REF_HEADER(ptr)->size;
+    if (ptr == bump_last
+	&& REF_ALIGN(size) <= (size_t)(bump_end - (char *)ptr)) {
+	bump_next = (char *)ptr + REF_ALIGN(size);
+	REF_HEADER(ptr)->size = size;
+	return ptr;
+    }
+    if ((p = bump_malloc(size)) == NULL)
+	return NULL;
+    memcpy(p, ptr, old < size ? old : size);
+    return p;
+}
+
+/*
+ * bump_stats - Report the chunks used since init as the heap
+ */
+static void bump_stats(alloc_stats_t *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->heap = bump_heap;
+    st->mappings = bump_chunks;
+}
+
+/*
+ * ref_usable_size - The size that was asked for
+ */
+static size_t ref_usable_size(void *ptr)
+{
+    return REF_HEADER(ptr)->size;
+}
+
+static atomic_size_t oracle_live;   /* bytes requested and not freed */
+
+/*
+ * oracle_init - Forget the last run's blocks; their memory went back
+ *     to the C library with them
+ */
+static int oracle_init(void)
+{
+    atomic_store(&oracle_live, 0);
+    return 0;
+}
+
+/*
+ * oracle_malloc, oracle_free, oracle_realloc - The C library's, with
+ *     a count of the live bytes
+ */
+static void *oracle_malloc(size_t size)
+{
+    char *p;
+
+    if ((p = malloc(size + sizeof(ref_header_t))) == NULL)
+	return NULL;
+    p += sizeof(ref_header_t);
+    REF_HEADER(p)->size = size;
+    atomic_fetch_add(&oracle_live, size);
+    return p;
+}
+
+static void oracle_free(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    atomic_fetch_sub(&oracle_live, REF_HEADER(ptr)->size);
+    free(REF_HEADER(ptr));
+}
+
+static void *oracle_realloc(void *ptr, size_t size)
+{
+    size_t old;
+    char *p;
+
+    if (ptr == NULL)
+	return oracle_malloc(size);
+    old = REF_HEADER(ptr)->size;
+    if ((p = realloc(REF_HEADER(ptr), size + sizeof(ref_header_t))) == NULL)
+	return NULL;
+    p += sizeof(ref_header_t);
+    REF_HEADER(p)->size = size;
+    atomic_fetch_add(&oracle_live, size - old);
+    return p;
+}
+
+/*
+ * oracle_stats - Report the smallest heap that holds the live bytes:
+ *     no headers, no gaps, just whole pages. Its peak over a trace is
+ *     the live-byte maximum rounded up to a page.
+ */
+static void oracle_stats(alloc_stats_t *st)
+{
+    size_t page = mem_pagesize();
+
+    memset(st, 0, sizeof(*st));
+    st->heap = (atomic_load(&oracle_live) + page - 1) & ~(page - 1);
+    st->mappings = st->heap > 0;
+}
+
+static allocator_t allocators[] = {
+    {"mm", "mm malloc", MM_THREAD_SAFE, 1, mm_alloc_init,
+     mm_malloc, mm_free, mm_realloc, NULL, memlib_stats},
+    {"libc", "libc malloc", 1, 0, libc_init,
+     malloc, free, realloc, malloc_usable_size, NULL},
+    {"bump", "bump pointer (throughput bound)", 0, 0, bump_init,
+     bump_malloc, bump_free, bump_realloc, ref_usable_size, bump_stats},
+    {"oracle", "oracle (utilization bound)", 1, 0, oracle_init,
+     oracle_malloc, oracle_free, oracle_realloc, ref_usable_size,
+     oracle_stats},
+};
+#define NALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+/*
+ * alloc_find - Return the allocator called name, or NULL if there is
+ *     none
+ */
+allocator_t *alloc_find(char *name)
+{
+    int i;
+
+    for (i = 0; i < NALLOCATORS; i++)
+	if (strcmp(allocators[i].name, name) == 0)
+	    return &allocators[i];
+    return NULL;
+}
+
+/*
+ * alloc_names - Return the names of the allocators, separated by
+ *     commas
+ */
+char *alloc_names(void)
+{
+    static char names[256];
+    int i;
+
+    names[0] = '\0';
+    for (i = 0; i < NALLOCATORS; i++) {
+	if (i > 0)
+	    strcat(names, ", ");
+	strcat(names, allocators[i].name);
+    }
+    return names;
+}
@@ -0,0 +1,50 @@
+#ifndef __ALLOC_H_
+#define __ALLOC_H_
+
+/*
+ * alloc.h - the allocators that mdriver can evaluate
+ *
+ * Each allocator is a table of entry points, so that the driver
+ * replays a trace through the same code whichever allocator it runs
+ * on, and several of them can be compared in one run (-a). Adding one
+ * means writing its entry points and listing it in alloc.c.
+ *
+ * The driver checks that the blocks of an allocator that takes its
+ * heap from memlib lie in memory that memlib mapped.
+ *
+ * init starts the allocator on an empty heap, releasing whatever the
+ * last run left behind, and returns -1 if it fails. usable_size may
+ * be NULL if the allocator cannot tell how big a block is. stats is
+ * NULL for an allocator whose heap cannot be told apart from the
+ * driver's own memory, such as the C library's; its utilization is
+ * then not measured.
+ */
+#include <stddef.h>
+#include "memlib.h"
+
+/* What an allocator holds from the system */
+typedef struct {
+    size_t heap;        /* bytes of heap */
+    long mappings;      /* separate mappings that make up the heap */
+    mem_stats_t mem;    /* kernel activity through memlib since init */
+} alloc_stats_t;
+
+typedef struct {
+    char *name;         /* name given to -a */
+    char *desc;         /* what the results call it */
+    int thread_safe;    /* may be called from several threads at once */
+    int memlib;         /* takes its heap from memlib */
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    size_t (*usable_size)(void *ptr);
+    void (*stats)(alloc_stats_t *st);
+} allocator_t;
+
+#define ALLOC_MAX 8     /* most allocators in one run */
+
+allocator_t *alloc_find(char *name);
+char *alloc_names(void);
+
+#endif /* __ALLOC_H_ */
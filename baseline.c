@@ -0,0 +1,231 @@
+/*
+ * baseline.c - load saved results and compare a new run against them
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "baseline.h"
+
+#define MAXFIELDS 128 /* max columns in a results file */
+
+/*
+ * base_error - Report an error in a baseline file and exit
+ */
+static void base_error(char *path, char *msg)
+{
+    printf("Baseline %s: %s\n", path, msg);
+    exit(1);
+}
+
+/*
+ * split_csv - Split a CSV line in place into at most max fields,
+ *     removing the quotes around quoted fields, and return how many
+ */
+static int split_csv(char *line, char **fields, int max)
+{
+    char *in = line, *out;
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    while (n < max) {
+	fields[n++] = out = in;
+	if (*in == '"') {
+	    for (in++; *in; in++) {
+		if (*in == '"' && in[1] == '"')
+		    *out++ = *in++;   /* "" is an escaped quote */
+		else if (*in == '"') {
+		    in++;
+		    break;
+		}
+		else
+		    *out++ = *in;
+	    }
+	}
+	while (*in && *in != ',')
+	    *out++ = *in++;
+	if (*in == '\0') {
+	    *out = '\0';
+	    break;
+	}
+	in++;
+	*out = '\0';
+    }
+    return n;
+}
+
+/*
+ * find_column - Return the index of the column named name
+ */
+static int find_column(char **header, int n, char *name, char *path)
+{
+    char msg[256];
+    int i;
+
+    for (i = 0; i < n; i++)
+	if (strcmp(header[i], name) == 0)
+	    return i;
+    snprintf(msg, sizeof(msg), "no %s column (not written by -o csv?)", name);
+    base_error(path, msg);
+    return -1;
+}
+
+/*
+ * base_load - Read the mm rows of the results file at path
+ */
+baseline_t *base_load(char *path)
+{
+    FILE *in;
+    baseline_t *base;
+    base_trace_t *t;
+    char *line = NULL, *head = NULL, *fields[MAXFIELDS], *header[MAXFIELDS];
+    char *s, *end;
+    size_t len = 0, headlen = 0;
+    int nhead, n, alloc_col, trace_col, name_col, valid_col;
+    int ops_col, secs_col, util_col, samples_col;
+
+    if ((in = fopen(path, "r")) == NULL)
+	base_error(path, strerror(errno));
+    if (getline(&head, &headlen, in) < 0)
+	base_error(path, "empty file");
+    nhead = split_csv(head, header, MAXFIELDS);
+    alloc_col = find_column(header, nhead, "allocator", path);
+    trace_col = find_column(header, nhead, "trace", path);
+    name_col = find_column(header, nhead, "name", path);
+    valid_col = find_column(header, nhead, "valid", path);
+    ops_col = find_column(header, nhead, "ops", path);
+    secs_col = find_column(header, nhead, "secs", path);
+    util_col = find_column(header, nhead, "util", path);
+    samples_col = find_column(header, nhead, "samples", path);
+
+    if ((base = calloc(1, sizeof(baseline_t))) == NULL)
+	base_error(path, "out of memory");
+    while (getline(&line, &len, in) >= 0) {
+	n = split_csv(line, fields, MAXFIELDS);
+	if (n != nhead)
+	    base_error(path, "row with the wrong number of columns");
+	if (strcmp(fields[alloc_col], "mm") != 0
+	    || strcmp(fields[trace_col], "total") == 0)
+	    continue;
+
+	base->traces = realloc(base->traces,
+			       (base->n + 1) * sizeof(base_trace_t));
+	if (base->traces == NULL)
+	    base_error(path, "out of memory");
+	t = &base->traces[base->n++];
+	memset(t, 0, sizeof(*t));
+	t->name = strdup(fields[name_col]);
+	t->valid = atoi(fields[valid_col]);
+	t->ops = atof(fields[ops_col]);
+	t->secs = atof(fields[secs_col]);
+	t->util = atof(fields[util_col]);
+	for (s = fields[samples_col]; t->nsamples < FSECS_MAX_SAMPLES; s = end) {
+	    t->samples[t->nsamples] = strtod(s, &end);
+	    if (end == s)
+		break;
+	    t->nsamples++;
+	}
+    }
+    free(line);
+    free(head);
+    fclose(in);
+    return base;
+}
+
+/*
+ * base_find - Return the baseline of the trace called name, or NULL
+ */
+base_trace_t *base_find(baseline_t *base, char *name)
+{
+    int i;
+
+    for (i = 0; i < base->n; i++)
+	if (strcmp(base->traces[i].name, name) == 0)
+	    return &base->traces[i];
+    return NULL;
+}
+
+/*
+ * base_free - Free a baseline read by base_load
+ */
+void base_free(baseline_t *base)
+{
+    int i;
+
+    for (i = 0; i < base->n; i++)
+	free(base->traces[i].name);
+    free(base->traces);
+    free(base);
+}
+
+/*
+ * base_kops - Turn the n run times in samples of a trace of ops
+ *     requests into throughputs in Kops
+ */
+void base_kops(double ops, double *samples, int n, double *kops)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	kops[i] = (ops/1e3) / samples[i];
+}
+
+/*
+ * base_mean_sd - Compute the mean and sample standard deviation of x
+ */
+void base_mean_sd(double *x, int n, double *mean, double *sd)
+{
+    double sum = 0, sq = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+	sum += x[i];
+    *mean = n > 0 ? sum / n : 0;
+    for (i = 0; i < n; i++)
+	sq += (x[i] - *mean) * (x[i] - *mean);
+    *sd = n > 1 ? sqrt(sq / (n - 1)) : 0;
+}
+
+/*
+ * t95 - Return the two-sided 95% quantile of Student's t with df
+ *     degrees of freedom
+ */
+static double t95(double df)
+{
+    static double table[] = {
+	12.71, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    int i = (int)floor(df);
+
+    if (i < 1)
+	i = 1;
+    if (i > 30)
+	return 1.96;
+    return table[i - 1];
+}
+
+/*
+ * base_diff_ci - Return the half-width of the 95% confidence interval
+ *     of mean(b) - mean(a) by Welch's t-test, or -1 if either side has
+ *     fewer than two samples
+ */
+double base_diff_ci(double *a, int na, double *b, int nb)
+{
+    double ma, sa, mb, sb, va, vb, df;
+
+    if (na < 2 || nb < 2)
+	return -1;
+    base_mean_sd(a, na, &ma, &sa);
+    base_mean_sd(b, nb, &mb, &sb);
+    va = sa * sa / na;
+    vb = sb * sb / nb;
+    if (va + vb == 0)
+	return 0;
+    df = (va + vb) * (va + vb)
+	/ (va * va / (na - 1) + vb * vb / (nb - 1));
+    return t95(df) * sqrt(va + vb);
+}
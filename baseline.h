@@ -0,0 +1,38 @@
+#ifndef __BASELINE_H_
+#define __BASELINE_H_
+
+/*
+ * baseline.h - saved results to compare a new run against
+ *
+ * A baseline is the CSV that mdriver prints with -o csv. Only its mm
+ * rows are used, matched to the new run by trace name, and the
+ * per-run times in its samples column give the spread of each
+ * trace's throughput.
+ */
+#include "fsecs.h"
+
+typedef struct {
+    char *name;          /* trace file name */
+    int valid;           /* did mm process the trace correctly? */
+    double ops;          /* requests in the trace */
+    double secs;         /* time of one run */
+    double util;         /* peak utilization */
+    int nsamples;        /* per-run times... */
+    double samples[FSECS_MAX_SAMPLES];
+} base_trace_t;
+
+typedef struct {
+    int n;
+    base_trace_t *traces;
+} baseline_t;
+
+baseline_t *base_load(char *path);
+base_trace_t *base_find(baseline_t *base, char *name);
+void base_free(baseline_t *base);
+
+/* Statistics for comparing runs */
+void base_kops(double ops, double *samples, int n, double *kops);
+void base_mean_sd(double *x, int n, double *mean, double *sd);
+double base_diff_ci(double *a, int na, double *b, int nb);
+
+#endif /* __BASELINE_H_ */
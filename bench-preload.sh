@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+# bench-preload.sh - time real programs on libc malloc and on mm.c
+#
+# Runs each command RUNS times (3 by default) with and without
+# libmmpreload.so and prints the best wall-clock time of each, so that
+# mm.c can be tried as a process allocator before it is rolled out.
+# A command that fails or crashes on mm.c is reported as such, and so
+# is one whose output differs from its output on libc; neither is
+# timed.
+#
+# Usage: ./bench-preload.sh [runs]
+# Set MMPRELOAD to time another build of the library.
+#
+RUNS=${1:-3}
+DIR=$(cd "$(dirname "$0")" && pwd)
+LIB=${MMPRELOAD:-$DIR/libmmpreload.so}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+if [ ! -f "$LIB" ]; then
+    echo "$LIB not found; run make preload first" >&2
+    exit 1
+fi
+
+# Inputs for the commands
+seq 1 1000000 | awk 'BEGIN { srand(1) } { print rand(), $0 }' > "$TMP/lines"
+PYTHON=$(command -v python3 || command -v python)
+
+# now - Print the time in nanoseconds
+now() {
+    date +%s%N
+}
+
+# best - Print the best time in seconds of RUNS runs of a command, with
+#     LD_PRELOAD set to $1, or "failed" if any run fails. The output of
+#     each run is saved in $TMP/$2, and must match $TMP/libc.out unless
+#     $2 is libc.out itself; if not, print "wrong output".
+best() {
+    preload=$1
+    out=$TMP/$2
+    shift 2
+    min=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+	start=$(now)
+	if ! LD_PRELOAD=$preload "$@" > "$out" 2> "$TMP/err"; then
+	    echo failed
+	    return
+	fi
+	t=$(( $(now) - start ))
+	if [ "$out" != "$TMP/libc.out" ] && ! cmp -s "$out" "$TMP/libc.out"; then
+	    echo wrong output
+	    return
+	fi
+	if [ -z "$min" ] || [ $t -lt $min ]; then
+	    min=$t
+	fi
+	i=$((i + 1))
+    done
+    awk -v t="$min" 'BEGIN { printf "%.3f", t / 1e9 }'
+}
+
+# bench - Time a command on both allocators and print a row
+bench() {
+    name=$1
+    shift
+    libc=$(best "" libc.out "$@")
+    if [ "$libc" = failed ]; then
+	printf "%-10s %10s %10s %8s\n" "$name" failed - -
+	return
+    fi
+    mm=$(best "$LIB" mm.out "$@")
+    ratio=$(awk -v a="$libc" -v b="$mm" \
+	'BEGIN { if (a + 0 > 0 && b + 0 > 0) printf "%.2f", b / a; else print "-" }')
+    printf "%-10s %10s %10s %8s\n" "$name" "$libc" "$mm" "$ratio"
+}
+
+printf "%-10s %10s %10s %8s\n" "command" "libc secs" "mm secs" "mm/libc"
+bench gcc gcc -O2 -c "$DIR/mdriver.c" -I"$DIR" -DBUILD_CFLAGS='""' -o "$TMP/mdriver.o"
+bench sort sort "$TMP/lines"
+if [ -n "$PYTHON" ]; then
+    bench python "$PYTHON" -c '
+import json
+d = {str(i): [i, str(i) * 8, {"k": i}] for i in range(300000)}
+s = json.dumps(d)
+print(len(json.loads(s)))
+'
+fi
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/times.h>
+#include <time.h>
 #include "clock.h"
 
 
@@ -71,6 +72,75 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+int counter_available()
+{
+    return 1;
+}
+
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *
+ * The start is read with lfence; rdtsc, so that earlier instructions
+ * finish first, and the end with rdtscp; lfence, so that the timed
+ * code finishes before it and later code waits for it. CPUs without
+ * rdtscp use lfence; rdtsc at the end as well.
+ *******************************************************/
+#include <x86intrin.h>
+#include <cpuid.h>
+
+static unsigned long long cyc_start = 0;
+static int have_rdtscp = -1;
+
+static unsigned long long read_start(void)
+{
+    _mm_lfence();
+    return __rdtsc();
+}
+
+static unsigned long long read_end(void)
+{
+    unsigned aux, a, b, c, d;
+    unsigned long long t;
+
+    if (have_rdtscp < 0)
+	have_rdtscp = __get_cpuid(0x80000001, &a, &b, &c, &d)
+	    && (d & (1 << 27));
+    if (!have_rdtscp)
+	return read_start();
+    t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = read_start();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(read_end() - cyc_start);
+}
+
+int counter_available()
+{
+    return 1;
+}
+
+/*
+ * tsc_invariant - Does the TSC tick at a constant rate in every P-,
+ *     C- and T-state? If not, cycle counts can't be turned into time.
+ */
+int tsc_invariant()
+{
+    unsigned a, b, c, d;
+
+    return __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1 << 8));
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -133,6 +203,11 @@ double get_counter()
     return result;
 }
 
+int counter_available()
+{
+    return 1;
+}
+
 #else
 
 /****************************************************************
@@ -158,6 +233,18 @@ double get_counter()
     printf("Please choose another timing package in config.h.\n");
     exit(1);
 }
+
+int counter_available()
+{
+    return 0;
+}
+#endif
+
+#if !defined(__x86_64__)
+int tsc_invariant()
+{
+    return 1; /* assume the counter of older machines ticks steadily */
+}
 #endif
 
 
@@ -201,6 +288,46 @@ double mhz(int verbose)
     return mhz_full(verbose, 2);
 }
 
+#define CALIBRATE_NSECS 50000000 /* 50 ms per tsc_mhz round */
+#define CALIBRATE_ROUNDS 5
+
+static double raw_nsecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * tsc_mhz - Estimate the counter rate against CLOCK_MONOTONIC_RAW,
+ *     spinning rather than sleeping so that the rounds are short, and
+ *     take the median of several rounds
+ */
+double tsc_mhz(int verbose)
+{
+    double rates[CALIBRATE_ROUNDS], t0, t1, rate;
+    int i, j;
+
+    for (i = 0; i < CALIBRATE_ROUNDS; i++) {
+	t0 = raw_nsecs();
+	start_counter();
+	do
+	    t1 = raw_nsecs();
+	while (t1 - t0 < CALIBRATE_NSECS);
+	rate = get_counter() / ((t1 - t0) / 1e3);
+
+	/* Insertion sort */
+	for (j = i; j > 0 && rates[j-1] > rate; j--)
+	    rates[j] = rates[j-1];
+	rates[j] = rate;
+    }
+    rate = rates[CALIBRATE_ROUNDS / 2];
+    if (verbose) 
+	printf("Processor clock rate ~= %.1f MHz\n", rate);
+    return rate;
+}
+
 /** Special counters that compensate for timer interrupt overhead */
 
 static double cyc_per_tick = 0.0;
@@ -6,6 +6,12 @@ void start_counter();
 /* Get # cycles since counter started */
 double get_counter();
 
+/* Is there a cycle counter on this platform? */
+int counter_available();
+
+/* Does the counter tick at a constant rate (x86-64 invariant TSC)? */
+int tsc_invariant();
+
 /* Measure overhead for counter */
 double ovhd();
 
@@ -15,6 +21,9 @@ double mhz(int verbose);
 /* Determine clock rate of processor, having more control over accuracy */
 double mhz_full(int verbose, int sleeptime);
 
+/* Determine the counter rate quickly against CLOCK_MONOTONIC_RAW */
+double tsc_mhz(int verbose);
+
 /** Special counters that compensate for timer interrupt overhead */
 
 void start_comp_counter();
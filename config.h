@@ -39,7 +39,8 @@
  * contribution of throughput to the performance index. Once the
  * students surpass the AVG_LIBC_THRUPUT, they get no further benefit
  * to their score.  This deters students from building extremely fast,
- * but extremely stupid malloc packages.
+ * but extremely stupid malloc packages. mdriver -B measures the
+ * bounds on the machine at hand instead, without changing the score.
  */
 #define AVG_LIBC_THRUPUT      7500E3  /* 7500 Kops/sec */
 
@@ -57,9 +58,11 @@
 #define ALIGNMENT 16
 
 /*****************************************************************************
- * Set exactly one of these USE_xxx constants to "1" to select a timing method
+ * Set exactly one of these USE_xxx constants to "1" to select the default
+ * timing method. All of them use the K-best scheme, and mdriver -T picks
+ * another one (or CLOCK_MONOTONIC_RAW) at run time.
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_FCYC   0   /* cycle counter (x86, x86-64 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
 #define USE_GETTOD 1   /* gettimeofday (any Unix box) */
 
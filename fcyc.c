@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <sys/times.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 #include "fcyc.h"
 #include "clock.h"
@@ -17,24 +19,41 @@
 /* Default values */
 #define K 3                  /* Value of K in K-best scheme */
 #define MAXSAMPLES 20        /* Give up after MAXSAMPLES */
+#define MINSAMPLES 0         /* Take at least MINSAMPLES, converged or not */
 #define EPSILON 0.01         /* K samples should be EPSILON of each other*/
 #define COMPENSATE 0         /* 1-> try to compensate for clock ticks */
 #define CLEAR_CACHE 0        /* Clear cache before running test function */
 #define CACHE_BYTES (1<<19)  /* Max cache size in bytes */
 #define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define WARMUP 0             /* Untimed runs before the first sample */
 
 static int kbest = K;
 static int maxsamples = MAXSAMPLES;
+static int minsamples = MINSAMPLES;
 static double epsilon = EPSILON;
 static int compensate = COMPENSATE;
 static int clear_cache = CLEAR_CACHE;
 static int cache_bytes = CACHE_BYTES;
 static int cache_block = CACHE_BLOCK;
+static int warmup = WARMUP;
 
 static int *cache_buf = NULL;
 
+/* the counter that fcyc reads, see set_fcyc_counter */
+static void (*counter_start)(void) = start_counter;
+static double (*counter_get)(void) = get_counter;
+
 static double *values = NULL;
 static int samplecount = 0;
+static double sample_sum = 0;   /* sum of all samples, for fcyc_cv */
+static double sample_sumsq = 0; /* and of their squares */
+
+static double last_cv = -1;
+
+/* the time of every run of the last fcyc call, in order, for fcyc_samples */
+#define MAX_RUNS 64
+static double last_runs[MAX_RUNS];
+static int last_nruns = 0;
 
 /* for debugging only */
 #define KEEP_VALS 0
@@ -59,6 +78,9 @@ static void init_sampler()
     samples = calloc(maxsamples+kbest, sizeof(double));
 #endif
     samplecount = 0;
+    last_nruns = 0;
+    sample_sum = 0;
+    sample_sumsq = 0;
 }
 
 /* 
@@ -77,7 +99,11 @@ static void add_sample(double val)
 #if KEEP_SAMPLES
     samples[samplecount] = val;
 #endif
+    if (last_nruns < MAX_RUNS)
+	last_runs[last_nruns++] = val;
     samplecount++;
+    sample_sum += val;
+    sample_sumsq += val*val;
     /* Insertion sort */
     while (pos > 0 && values[pos-1] > values[pos]) {
 	double temp = values[pos-1];
@@ -113,6 +139,8 @@ static void clear()
 	    fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
 	    exit(1);
 	}
+	/* Untouched pages all map to the zero page, which would stay cached */
+	memset(cache_buf, 1, cache_bytes);
     }
     cptr = (int *) cache_buf;
     cend = cptr + cache_bytes/sizeof(int);
@@ -123,14 +151,26 @@ static void clear()
     sink = x;
 }
 
+/*
+ * fcyc_clear_cache - Clear the cache now, for callers that time a
+ *     function themselves
+ */
+void fcyc_clear_cache(void)
+{
+    clear();
+}
+
 /*
  * fcyc - Use K-best scheme to estimate the running time of function f
  */
 double fcyc(test_funct f, void *argp)
 {
-    double result;
+    double result, mean;
+    int i;
     init_sampler();
-    if (compensate) {
+    for (i = 0; i < warmup; i++)
+	f(argp);
+    if (compensate && counter_start == start_counter) {
 	do {
 	    double cyc;
 	    if (clear_cache)
@@ -139,17 +179,19 @@ double fcyc(test_funct f, void *argp)
 	    f(argp);
 	    cyc = get_comp_counter();
 	    add_sample(cyc);
-	} while (!has_converged() && samplecount < maxsamples);
+	} while ((samplecount < minsamples || !has_converged())
+		 && samplecount < maxsamples);
     } else {
 	do {
 	    double cyc;
 	    if (clear_cache)
 		clear();
-	    start_counter();
+	    counter_start();
 	    f(argp);
-	    cyc = get_counter();
+	    cyc = counter_get();
 	    add_sample(cyc);
-	} while (!has_converged() && samplecount < maxsamples);
+	} while ((samplecount < minsamples || !has_converged())
+		 && samplecount < maxsamples);
     }
 #ifdef DEBUG
     {
@@ -160,6 +202,11 @@ double fcyc(test_funct f, void *argp)
     }
 #endif
     result = values[0];
+    last_cv = -1;
+    if (samplecount > 1) {
+	mean = sample_sum / samplecount;
+	last_cv = sqrt(fmax(sample_sumsq / samplecount - mean*mean, 0)) / mean;
+    }
 #if !KEEP_VALS
     free(values); 
     values = NULL;
@@ -168,6 +215,30 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * fcyc_samples - Copy up to max of the counts of every run of the last
+ *     fcyc call into runs, in the order they were taken, and return how
+ *     many. Unlike the K best, they show the real spread of the runs.
+ */
+int fcyc_samples(double *runs, int max)
+{
+    int n = last_nruns < max ? last_nruns : max;
+
+    memcpy(runs, last_runs, n * sizeof(double));
+    return n;
+}
+
+/*
+ * fcyc_cv - Return the coefficient of variation (standard deviation
+ *     over mean) of all the samples of the last fcyc call, or -1 if it
+ *     took only one
+ */
+double fcyc_cv(void)
+{
+    return last_cv;
+}
+
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
@@ -206,6 +277,16 @@ void set_fcyc_cache_block(int bytes) {
 }
 
 
+/* 
+ * set_fcyc_warmup - Number of untimed runs of the test function
+ *     before the first measurement
+ *     Default = 0
+ */
+void set_fcyc_warmup(int runs)
+{
+    warmup = runs;
+}
+
 /* 
  * set_fcyc_compensate- When set, will attempt to compensate for 
  *     timer interrupt overhead 
@@ -216,6 +297,18 @@ void set_fcyc_compensate(int compensate_arg)
     compensate = compensate_arg;
 }
 
+/*
+ * set_fcyc_counter - Use start and get instead of the cycle counter,
+ *     to apply the K-best scheme to other clocks. fcyc then returns
+ *     time in the units of get. Compensation for timer interrupts only
+ *     applies to the cycle counter.
+ */
+void set_fcyc_counter(void (*start)(void), double (*get)(void))
+{
+    counter_start = start;
+    counter_get = get;
+}
+
 /* 
  * set_fcyc_k - Value of K in K-best measurement scheme
  *     Default = 3
@@ -236,6 +329,16 @@ void set_fcyc_maxsamples(int maxsamples_arg)
     maxsamples = maxsamples_arg;
 }
 
+/* 
+ * set_fcyc_minsamples - Minimum number of samples, even when the K
+ *     best have converged sooner
+ *     Default = 0
+ */
+void set_fcyc_minsamples(int minsamples_arg)
+{
+    minsamples = minsamples_arg;
+}
+
 /* 
  * set_fcyc_epsilon - Tolerance required for K-best
  *     Default = 0.01
@@ -13,6 +13,15 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Get the count of every run of the last call to fcyc, in order */
+int fcyc_samples(double *runs, int max);
+
+/* Coefficient of variation of all the samples of the last call to fcyc */
+double fcyc_cv(void);
+
+/* Clear the cache as fcyc does before each measurement */
+void fcyc_clear_cache(void);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -36,6 +45,13 @@ void set_fcyc_cache_size(int bytes);
  */
 void set_fcyc_cache_block(int bytes);
 
+/* 
+ * set_fcyc_warmup - Number of untimed runs of the test function
+ *     before the first measurement
+ *     Default = 0
+ */
+void set_fcyc_warmup(int runs);
+
 /* 
  * set_fcyc_compensate- When set, will attempt to compensate for 
  *     timer interrupt overhead 
@@ -43,6 +59,13 @@ void set_fcyc_cache_block(int bytes);
  */
 void set_fcyc_compensate(int compensate_arg);
 
+/* 
+ * set_fcyc_counter - Measure with start and get instead of the cycle
+ *     counter (start_counter and get_counter); fcyc then returns time
+ *     in the units of get
+ */
+void set_fcyc_counter(void (*start)(void), double (*get)(void));
+
 /* 
  * set_fcyc_k - Value of K in K-best measurement scheme
  *     Default = 3
@@ -57,6 +80,13 @@ void set_fcyc_k(int k);
  */
 void set_fcyc_maxsamples(int maxsamples_arg);
 
+/* 
+ * set_fcyc_minsamples - Minimum number of samples, even if the K best
+ *     converge sooner, so that the spread of the runs is known.
+ *     Default = 0
+ */
+void set_fcyc_minsamples(int minsamples_arg);
+
 /* 
  * set_fcyc_epsilon - Tolerance required for K-best
  *     Default = 0.01
@@ -2,6 +2,8 @@
  * High-level timing wrappers
  ****************************/
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -10,8 +12,108 @@
 
 static double Mhz;  /* estimated CPU clock frequency */
 
+/*
+ * Timed runs of each fsecs call, however soon the K best converge. The
+ * coarse timers used to time this many runs one by one, and -b needs
+ * that many samples for its confidence interval whatever the timer.
+ */
+#define MIN_RUNS 10
+
+/*
+ * The timers fsecs can measure with. Each is a counter that fcyc runs
+ * its K-best scheme on; units is how many counts make a second.
+ */
+typedef struct {
+    char *name;              /* name given to fsecs_set_timer */
+    char *desc;              /* what fsecs_method reports */
+    void (*start)(void);
+    double (*get)(void);
+    double units;            /* counts per second, 0 if calibrated */
+} timer_desc_t;
+
+static timer_desc_t timers[] = {
+    {"tsc", "cycle counter", start_counter, get_counter, 0},
+    {"monotonic", "clock_gettime(CLOCK_MONOTONIC_RAW)",
+     start_monotonic, get_monotonic, 1e9},
+    {"gettod", "gettimeofday", start_gettod, get_gettod, 1e6},
+    {"itimer", "interval timer", start_itimer, get_itimer, 1},
+};
+#define NTIMERS (sizeof(timers) / sizeof(timers[0]))
+
+/* The default timer is the one config.h asks for */
+#if USE_FCYC
+static timer_desc_t *timer = &timers[0];
+#elif USE_ITIMER
+static timer_desc_t *timer = &timers[3];
+#else
+static timer_desc_t *timer = &timers[2];
+#endif
+
+/* per-run times of the last fsecs call, and their spread */
+static double samples[FSECS_MAX_SAMPLES];
+static int nsamples = 0;
+static double cv = -1;
+
+/* Isolation of the timed runs */
+static int warmup = 0;          /* untimed runs before the timed ones */
+static long flush_bytes = -1;   /* cache flushed before each run, -1 = LLC */
+
 extern int verbose; /* -v option in mdriver.c */
 
+/*
+ * fsecs_set_timer - Measure with the timer called name instead of the
+ *     one config.h selects. Returns 0 if there is no such timer here.
+ */
+int fsecs_set_timer(char *name)
+{
+    int i;
+
+    for (i = 0; i < NTIMERS; i++) {
+	if (strcmp(timers[i].name, name) == 0) {
+	    if (timers[i].start == start_counter && !counter_available())
+		return 0;
+	    timer = &timers[i];
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * fsecs_set_warmup - Run the function runs times untimed before
+ *     timing it with fsecs
+ */
+void fsecs_set_warmup(int runs)
+{
+    warmup = runs;
+}
+
+/*
+ * fsecs_set_flush - Flush the cache by reading a buffer of bytes
+ *     before each timed run, or not at all if bytes is 0. By default
+ *     the buffer is twice the last level cache.
+ */
+void fsecs_set_flush(long bytes)
+{
+    flush_bytes = bytes;
+}
+
+/*
+ * llc_bytes - Return the size of the last level cache, or 0 if the
+ *     system does not say
+ */
+static long llc_bytes(void)
+{
+    long bytes = 0;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (bytes <= 0)
+	bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return (bytes > 0) ? bytes : 0;
+}
+
 /*
  * init_fsecs - initialize the timing package
  */
@@ -19,39 +121,111 @@ void init_fsecs(void)
 {
     Mhz = 0; /* keep gcc -Wall happy */
 
-#if USE_FCYC
     if (verbose)
-	printf("Measuring performance with a cycle counter.\n");
+	printf("Measuring performance with %s.\n", timer->desc);
 
     /* set key parameters for the fcyc package */
+    set_fcyc_counter(timer->start, timer->get);
     set_fcyc_maxsamples(20); 
-    set_fcyc_clear_cache(1);
+    set_fcyc_minsamples(MIN_RUNS);
+    if (flush_bytes < 0)
+	flush_bytes = llc_bytes() ? 2 * llc_bytes() : (1<<19);
+    set_fcyc_clear_cache(flush_bytes > 0);
+    if (flush_bytes > 0)
+	set_fcyc_cache_size(flush_bytes);
+    set_fcyc_cache_block(64);
+    set_fcyc_warmup(warmup);
     set_fcyc_compensate(1);
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
-    Mhz = mhz(verbose > 0);
-#elif USE_ITIMER
-    if (verbose)
-	printf("Measuring performance with the interval timer.\n");
-#elif USE_GETTOD
-    if (verbose)
-	printf("Measuring performance with gettimeofday().\n");
-#endif
+
+    if (timer->units == 0) {
+	if (!tsc_invariant())
+	    printf("Warning: the cycle counter is not invariant, so its "
+		   "times may be off.\n");
+	Mhz = tsc_mhz(verbose > 0);
+	timer->units = Mhz*1e6;
+    }
 }
 
 /*
- * fsecs - Return the running time of a function f (in seconds)
+ * fsecs - Return the running time of a function f (in seconds), as the
+ *     best of the K fastest runs. The time of every run is kept for
+ *     fsecs_samples, since the K fastest alone hide how much the runs
+ *     vary.
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
-#if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
-#elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
-#endif 
+    double counts = fcyc(f, argp);
+    int i;
+
+    nsamples = fcyc_samples(samples, FSECS_MAX_SAMPLES);
+    for (i = 0; i < nsamples; i++)
+	samples[i] /= timer->units;
+    cv = fcyc_cv();
+    return counts / timer->units;
 }
 
+/*
+ * fsecs_once - Return the running time of a single run of f, for
+ *     functions too slow to run more than once (or to warm up)
+ */
+double fsecs_once(fsecs_test_funct f, void *argp)
+{
+    if (flush_bytes > 0)
+	fcyc_clear_cache();
+    timer->start();
+    f(argp);
+    samples[0] = timer->get() / timer->units;
+    nsamples = 1;
+    cv = -1;
+    return samples[0];
+}
+
+/*
+ * fsecs_samples - Copy the per-run times of the last fsecs call into
+ *     out, which has room for FSECS_MAX_SAMPLES, and return how many
+ *     there are
+ */
+int fsecs_samples(double *out)
+{
+    int i;
 
+    for (i = 0; i < nsamples; i++)
+	out[i] = samples[i];
+    return nsamples;
+}
+
+/*
+ * fsecs_cv - Return the coefficient of variation of all the timed runs
+ *     of the last fsecs call, not just the K best, or -1 if there was
+ *     only one run
+ */
+double fsecs_cv(void)
+{
+    return cv;
+}
+
+/*
+ * fsecs_flush_bytes - Return how many bytes are read to flush the
+ *     cache before each timed run, 0 if none
+ */
+long fsecs_flush_bytes(void)
+{
+    return flush_bytes;
+}
+
+/*
+ * fsecs_method - Describe how fsecs measures running times
+ */
+char *fsecs_method(void)
+{
+    static char desc[128];
+
+    if (timer->start == start_counter)
+	snprintf(desc, sizeof(desc), "%s at %.1f MHz, K-best",
+		 timer->desc, Mhz);
+    else
+	snprintf(desc, sizeof(desc), "%s, K-best", timer->desc);
+    return desc;
+}
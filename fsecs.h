@@ -1,4 +1,17 @@
 typedef void (*fsecs_test_funct)(void *);
 
+int fsecs_set_timer(char *name);  /* tsc, monotonic, gettod or itimer */
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_once(fsecs_test_funct f, void *argp);
+char *fsecs_method(void);
+
+/* Isolation of the timed runs; set before init_fsecs */
+void fsecs_set_warmup(int runs);   /* untimed runs before timing */
+void fsecs_set_flush(long bytes);  /* cache flushed before each run */
+long fsecs_flush_bytes(void);
+
+/* Times of every run of the last fsecs call, for confidence intervals */
+#define FSECS_MAX_SAMPLES 32  /* at least set_fcyc_maxsamples in init_fsecs */
+int fsecs_samples(double *samples);
+double fsecs_cv(void);  /* spread of all the runs, -1 if only one */
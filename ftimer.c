@@ -7,8 +7,12 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *
+ * The start_xxx/get_xxx pairs read the same clocks, and the monotonic
+ * clock, as counters that fcyc can run its K-best scheme on.
  */
 #include <stdio.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
@@ -53,6 +57,53 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
 }
 
 
+/*
+ * Counters for fcyc. Each get_xxx returns the time since the last
+ * start_xxx, in the units given in ftimer.h.
+ */
+static struct timespec mono_start;
+static struct timeval tod_start;
+static double itimer_start;
+
+void start_monotonic(void)
+{
+    clock_gettime(CLOCK_MONOTONIC_RAW, &mono_start);
+}
+
+double get_monotonic(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return 1E9*(now.tv_sec - mono_start.tv_sec)
+	+ (now.tv_nsec - mono_start.tv_nsec);
+}
+
+void start_gettod(void)
+{
+    gettimeofday(&tod_start, NULL);
+}
+
+double get_gettod(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return 1E6*(now.tv_sec - tod_start.tv_sec)
+	+ (now.tv_usec - tod_start.tv_usec);
+}
+
+void start_itimer(void)
+{
+    init_etime();
+    itimer_start = get_etime();
+}
+
+double get_itimer(void)
+{
+    return get_etime() - itimer_start;
+}
+
 /*
  * Routines for manipulating the Unix interval timer
  */
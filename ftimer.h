@@ -12,3 +12,11 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Counters for fcyc's K-best scheme: start_xxx starts the counter and
+   get_xxx returns the time since then */
+void start_monotonic(void);   /* CLOCK_MONOTONIC_RAW, in ns */
+double get_monotonic(void);
+void start_gettod(void);      /* gettimeofday, in us */
+double get_gettod(void);
+void start_itimer(void);      /* interval timer, in secs */
+double get_itimer(void);
@@ -0,0 +1,446 @@
+/*
+ * gen.c - synthetic traces generated in memory
+ *
+ * The generator walks forward one request at a time. It frees the
+ * live block that dies first once its lifetime is up, or once the
+ * live bytes exceed the target; otherwise it reallocs a random live
+ * block or allocates a new one. Live blocks sit both in a min-heap
+ * keyed by their time of death and in an array, from which reallocs
+ * pick at random. The last requests free whatever is still live.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "gen.h"
+
+#define MAXLINE   1024
+#define MAXCLASS  64             /* most values in a classes: list */
+#define MAXSIZE   (1 << 30)      /* largest request size */
+
+/* A distribution of sizes or lifetimes */
+typedef struct {
+    enum {FIXED, UNIFORM, POWER, BIMODAL, CLASSES, EXP} kind;
+    double a, b, c;              /* parameters, as in gen.h */
+    int nclasses;
+    double classes[MAXCLASS];
+} dist_t;
+
+/* The settings of a spec */
+typedef struct {
+    uint64_t seed;
+    int ops;
+    dist_t size;
+    dist_t life;
+    double live;
+    double realloc_p;            /* chance of a realloc */
+    double grow;                 /* growth of a realloc... */
+    int grow_add;                /* ... in bytes if set, else a factor */
+} spec_t;
+
+/* A live block, in the heap and in the live array */
+typedef struct {
+    long death;                  /* request at which it is freed */
+    int id;
+} heapent_t;
+
+static char *cur_spec;           /* the spec being parsed, for errors */
+
+/*
+ * gen_error - Report a bad spec and exit
+ */
+static void gen_error(char *msg)
+{
+    printf("Bad generator spec \"%s\": %s\n", cur_spec, msg);
+    exit(1);
+}
+
+/*
+ * random_next - Return the next number of the splitmix64 generator,
+ *     which gives the same sequence on every platform
+ */
+static uint64_t random_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * random_unit - Return a uniform double in [0, 1)
+ */
+static double random_unit(uint64_t *state)
+{
+    return (random_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * parse_number - Parse a number with an optional k, m or g suffix
+ */
+static double parse_number(char *s, char **end)
+{
+    double x;
+
+    errno = 0;
+    x = strtod(s, end);
+    if (*end == s || errno != 0)
+	gen_error("expected a number");
+    switch (**end) {
+    case 'k': case 'K': x *= 1024; (*end)++; break;
+    case 'm': case 'M': x *= 1024 * 1024; (*end)++; break;
+    case 'g': case 'G': x *= 1024 * 1024 * 1024; (*end)++; break;
+    }
+    return x;
+}
+
+/*
+ * parse_params - Parse n colon-separated numbers after a dist's kind
+ */
+static void parse_params(char *s, int n, double *p)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+	if (*s != ':')
+	    gen_error("distribution has too few parameters");
+	p[i] = parse_number(s + 1, &s);
+    }
+    if (*s != '\0')
+	gen_error("distribution has too many parameters");
+}
+
+/*
+ * parse_dist - Parse a DIST
+ */
+static void parse_dist(char *s, dist_t *d)
+{
+    double p[3] = {0, 0, 0};
+    char *end;
+    size_t len = strcspn(s, ":");
+
+    memset(d, 0, sizeof(dist_t));
+    if (strncmp(s, "fixed", len) == 0 && len == 5) {
+	d->kind = FIXED;
+	parse_params(s + len, 1, p);
+    }
+    else if (strncmp(s, "uniform", len) == 0 && len == 7) {
+	d->kind = UNIFORM;
+	parse_params(s + len, 2, p);
+	if (p[1] < p[0])
+	    gen_error("uniform needs MIN <= MAX");
+    }
+    else if (strncmp(s, "power", len) == 0 && len == 5) {
+	d->kind = POWER;
+	parse_params(s + len, 3, p);
+	if (p[0] < 1 || p[1] < p[0] || p[2] <= 0)
+	    gen_error("power needs 1 <= MIN <= MAX and ALPHA > 0");
+    }
+    else if (strncmp(s, "bimodal", len) == 0 && len == 7) {
+	d->kind = BIMODAL;
+	parse_params(s + len, 3, p);
+	if (p[2] < 0 || p[2] > 1)
+	    gen_error("bimodal needs 0 <= P <= 1");
+    }
+    else if (strncmp(s, "exp", len) == 0 && len == 3) {
+	d->kind = EXP;
+	parse_params(s + len, 1, p);
+    }
+    else if (strncmp(s, "classes", len) == 0 && len == 7) {
+	d->kind = CLASSES;
+	for (s += len; *s == ':' || *s == '/'; s = end) {
+	    if (d->nclasses == MAXCLASS)
+		gen_error("too many classes");
+	    d->classes[d->nclasses++] = parse_number(s + 1, &end);
+	}
+	if (*s != '\0' || d->nclasses == 0)
+	    gen_error("classes needs a list A/B/...");
+	return;
+    }
+    else
+	gen_error("unknown distribution");
+    d->a = p[0];
+    d->b = p[1];
+    d->c = p[2];
+}
+
+/*
+ * sample - Draw a whole number of at least 1 from a distribution
+ */
+static long sample(dist_t *d, uint64_t *state)
+{
+    double u = random_unit(state), x, la, lb;
+
+    switch (d->kind) {
+    case FIXED:
+	x = d->a;
+	break;
+    case UNIFORM:
+	x = d->a + floor(u * (d->b - d->a + 1));
+	break;
+    case POWER:
+	/* Inverse of the bounded Pareto CDF */
+	la = pow(d->a, d->c);
+	lb = pow(d->b, d->c);
+	x = pow((lb - u * (lb - la)) / (la * lb), -1.0 / d->c);
+	break;
+    case BIMODAL:
+	x = (u < d->c) ? d->a : d->b;
+	break;
+    case CLASSES:
+	x = d->classes[(int)(u * d->nclasses)];
+	break;
+    case EXP:
+    default:
+	x = -d->a * log(1 - u);
+	break;
+    }
+    return (x < 1) ? 1 : (long)x;
+}
+
+/*
+ * check_size_dist - Reject a size distribution whose sizes can be
+ *     larger than MAXSIZE
+ */
+static void check_size_dist(dist_t *d)
+{
+    double top;
+    int i;
+
+    switch (d->kind) {
+    case FIXED:
+    case EXP:
+	top = d->a;
+	break;
+    case BIMODAL:
+	top = (d->a > d->b) ? d->a : d->b;
+	break;
+    case CLASSES:
+	for (top = 0, i = 0; i < d->nclasses; i++)
+	    if (d->classes[i] > top)
+		top = d->classes[i];
+	break;
+    default:
+	top = d->b;
+	break;
+    }
+    if (top > MAXSIZE)
+	gen_error("sizes can be at most 1g");
+}
+
+/*
+ * parse_spec - Parse a spec into its settings
+ */
+static void parse_spec(char *spec, spec_t *sp)
+{
+    char buf[MAXLINE], *key, *val, *end, *save;
+    double ops;
+
+    if (strlen(spec) >= MAXLINE)
+	gen_error("too long");
+    strcpy(buf, spec);
+
+    sp->seed = 1;
+    sp->ops = 100000;
+    parse_dist("uniform:1:4096", &sp->size);
+    parse_dist("exp:1000", &sp->life);
+    sp->live = 1024 * 1024;
+    sp->realloc_p = 0;
+    sp->grow = 2;
+    sp->grow_add = 0;
+
+    for (key = strtok_r(buf, ",", &save); key; key = strtok_r(NULL, ",", &save)) {
+	if ((val = strchr(key, '=')) == NULL)
+	    gen_error("expected key=value");
+	*val++ = '\0';
+	if (strcmp(key, "seed") == 0)
+	    sp->seed = strtoull(val, NULL, 0);
+	else if (strcmp(key, "ops") == 0) {
+	    if ((ops = parse_number(val, &end)) < 2 || *end)
+		gen_error("ops needs at least 2 requests");
+	    if (ops > INT_MAX)
+		gen_error("ops can be at most 2147483647");
+	    sp->ops = (int)ops;
+	}
+	else if (strcmp(key, "size") == 0) {
+	    parse_dist(val, &sp->size);
+	    check_size_dist(&sp->size);
+	}
+	else if (strcmp(key, "life") == 0)
+	    parse_dist(val, &sp->life);
+	else if (strcmp(key, "live") == 0) {
+	    if ((sp->live = parse_number(val, &end)) <= 0 || *end)
+		gen_error("live needs a positive number of bytes");
+	}
+	else if (strcmp(key, "realloc") == 0) {
+	    sp->realloc_p = parse_number(val, &end);
+	    if (*end == ':') {
+		end++;
+		sp->grow_add = (*end == '+');
+		if (*end == '+' || *end == 'x')
+		    end++;
+		sp->grow = parse_number(end, &end);
+	    }
+	    if (*end || sp->realloc_p < 0 || sp->realloc_p > 1
+		|| (!sp->grow_add && sp->grow < 1))
+		gen_error("realloc needs P:xF with F >= 1, or P:+N");
+	    if (sp->grow_add && sp->grow > MAXSIZE)
+		gen_error("realloc can grow a block by at most 1g");
+	}
+	else
+	    gen_error("unknown key");
+    }
+}
+
+/*
+ * heap_push, heap_pop - The min-heap of live blocks by time of death
+ */
+static void heap_push(heapent_t *heap, int *n, long death, int id)
+{
+    int i = (*n)++, parent;
+
+    while (i > 0 && heap[parent = (i - 1) / 2].death > death) {
+	heap[i] = heap[parent];
+	i = parent;
+    }
+    heap[i].death = death;
+    heap[i].id = id;
+}
+
+static heapent_t heap_pop(heapent_t *heap, int *n)
+{
+    heapent_t top = heap[0], last = heap[--(*n)];
+    int i = 0, child;
+
+    while ((child = 2*i + 1) < *n) {
+	if (child + 1 < *n && heap[child + 1].death < heap[child].death)
+	    child++;
+	if (heap[child].death >= last.death)
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/*
+ * gen_is_spec - Is this trace name a generator spec?
+ */
+int gen_is_spec(char *name)
+{
+    return strncmp(name, GEN_PREFIX, strlen(GEN_PREFIX)) == 0;
+}
+
+/*
+ * gen_trace - Generate the trace that a spec describes. The spec may
+ *     start with GEN_PREFIX.
+ */
+trace_t *gen_trace(char *spec)
+{
+    spec_t sp;
+    trace_t *trace;
+    traceop_t *op;
+    heapent_t *heap, dead;
+    int *live_ids, *live_pos, *sizes;
+    int nheap = 0, nlive = 0, nids = 0, i, id, room;
+    double live_bytes = 0, peak_bytes = 0, grown;
+    uint64_t state;
+
+    if (gen_is_spec(spec))
+	spec += strlen(GEN_PREFIX);
+    cur_spec = spec;
+    parse_spec(spec, &sp);
+    state = sp.seed;
+
+    /* At most ops/2 + 1 blocks are ever allocated in a balanced trace */
+    if ((trace = malloc(sizeof(trace_t))) == NULL
+	|| (trace->ops = malloc((sp.ops + 1) * sizeof(traceop_t))) == NULL
+	|| (heap = malloc((sp.ops / 2 + 1) * sizeof(heapent_t))) == NULL
+	|| (live_ids = malloc((sp.ops / 2 + 1) * sizeof(int))) == NULL
+	|| (live_pos = malloc((sp.ops / 2 + 1) * sizeof(int))) == NULL
+	|| (sizes = malloc((sp.ops / 2 + 1) * sizeof(int))) == NULL) {
+	printf("malloc failed in gen_trace: %s\n", strerror(errno));
+	exit(1);
+    }
+
+    for (i = 0; i < sp.ops; i++) {
+	op = &trace->ops[i];
+	op->tid = 0;
+	room = sp.ops - i - nlive; /* requests not needed to free the rest */
+
+	/*
+	 * Free when a block is due, the live set is full, or to finish.
+	 * With one spare request left, an alloc would have no room for
+	 * its free, so free early and end the trace one request short.
+	 */
+	if (nlive > 0 && (heap[0].death <= i || live_bytes > sp.live
+			  || room < 2)) {
+	    dead = heap_pop(heap, &nheap);
+	    id = dead.id;
+	    op->type = FREE;
+	    op->index = id;
+	    op->size = 0;
+	    live_bytes -= sizes[id];
+	    live_ids[live_pos[id]] = live_ids[--nlive];
+	    live_pos[live_ids[nlive]] = live_pos[id];
+	    continue;
+	}
+
+	if (nlive > 0 && random_unit(&state) < sp.realloc_p) {
+	    id = live_ids[(int)(random_unit(&state) * nlive)];
+	    grown = sp.grow_add ? sizes[id] + sp.grow : ceil(sizes[id] * sp.grow);
+	    op->type = REALLOC;
+	    op->index = id;
+	    op->size = (grown > MAXSIZE) ? MAXSIZE : (int)grown;
+	    live_bytes += op->size - sizes[id];
+	    sizes[id] = op->size;
+	}
+	else if (room >= 2) {
+	    /* An alloc needs one more request left over for its free */
+	    id = nids++;
+	    op->type = ALLOC;
+	    op->index = id;
+	    op->size = sample(&sp.size, &state);
+	    if (op->size > MAXSIZE)
+		op->size = MAXSIZE;
+	    sizes[id] = op->size;
+	    live_bytes += op->size;
+	    live_pos[id] = nlive;
+	    live_ids[nlive++] = id;
+	    heap_push(heap, &nheap, i + sample(&sp.life, &state), id);
+	}
+	else {
+	    /* Nothing is live and only one request is left */
+	    sp.ops = i;
+	    break;
+	}
+	if (live_bytes > peak_bytes)
+	    peak_bytes = live_bytes;
+    }
+
+    trace->sugg_heapsize = (peak_bytes + 100 > INT32_MAX) ? INT32_MAX
+	: (int)peak_bytes + 100;
+    trace->num_ids = nids;
+    trace->num_ops = sp.ops;
+    trace->weight = 1;
+    trace->num_threads = 1;
+    trace->map = NULL;
+    trace->map_len = 0;
+    if ((trace->blocks = malloc((nids + 1) * sizeof(char *))) == NULL
+	|| (trace->block_sizes = malloc((nids + 1) * sizeof(size_t))) == NULL) {
+	printf("malloc failed in gen_trace: %s\n", strerror(errno));
+	exit(1);
+    }
+
+    free(heap);
+    free(live_ids);
+    free(live_pos);
+    free(sizes);
+    return trace;
+}
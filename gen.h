@@ -0,0 +1,38 @@
+#ifndef __GEN_H_
+#define __GEN_H_
+
+/*
+ * gen.h - synthetic traces generated in memory
+ *
+ * A generated trace is described by a spec of comma-separated
+ * key=value settings, for example
+ *     seed=7,ops=2000000,size=power:16:65536:1.2,life=exp:5000,live=8m
+ * The same spec always yields the same trace. The keys are
+ *     seed=N       seed of the random number generator (1)
+ *     ops=N        number of requests, at most 2147483647 (100000);
+ *                  the trace may end one request short so that
+ *                  every block is freed
+ *     size=DIST    request sizes in bytes, at most 1g (uniform:1:4096)
+ *     life=DIST    lifetime of a block, in later requests (exp:1000)
+ *     live=BYTES   most live bytes; the oldest-dying block is freed
+ *                  early to stay under it (1m)
+ *     realloc=P:G  chance P that a request reallocs a random live
+ *                  block, growing it by xF (times F) or +N bytes (0)
+ * and a DIST is one of
+ *     fixed:N                one value
+ *     uniform:MIN:MAX        uniform between MIN and MAX
+ *     power:MIN:MAX:ALPHA    power law (bounded Pareto) of shape ALPHA
+ *     bimodal:A:B:P          A with chance P, else B
+ *     classes:A/B/...        one of the values, each equally likely
+ *     exp:MEAN               exponential with mean MEAN
+ * Byte counts take a k, m or g suffix. Every block is freed by the
+ * end of the trace.
+ */
+#include "trace.h"
+
+#define GEN_PREFIX "gen:" /* trace names that are generator specs */
+
+int gen_is_spec(char *name);
+trace_t *gen_trace(char *spec);
+
+#endif /* __GEN_H_ */
@@ -0,0 +1,126 @@
+/*
+ * latency.c - per-request latency histograms
+ *
+ * The hot path (lat_now, lat_record) is inline in latency.h; this file
+ * calibrates the clock and turns the histograms into percentiles.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "latency.h"
+
+#define CALIBRATE_READS 1000 /* back-to-back clock reads in lat_init */
+
+char *lat_type_names[LAT_TYPES] = {"malloc", "free", "realloc"};
+char *lat_band_names[LAT_BANDS] = {
+    "<=64", "<=512", "<=4K", "<=64K", ">64K"
+};
+
+/*
+ * lat_init - Clear the histograms and measure the cost of a clock read,
+ *     taking the least of many back-to-back reads
+ */
+void lat_init(latency_t *lat)
+{
+    uint64_t t0, t1, least = UINT64_MAX;
+    int i;
+
+    memset(lat, 0, sizeof(*lat));
+    for (i = 0; i < CALIBRATE_READS; i++) {
+	t0 = lat_now();
+	t1 = lat_now();
+	if (t1 - t0 < least)
+	    least = t1 - t0;
+    }
+    lat->overhead = least;
+}
+
+/*
+ * lat_merge - Add the counts of h to into
+ */
+void lat_merge(lat_hist_t *into, lat_hist_t *h)
+{
+    int i;
+
+    into->count += h->count;
+    if (h->max > into->max)
+	into->max = h->max;
+    for (i = 0; i < LAT_BUCKETS; i++)
+	into->buckets[i] += h->buckets[i];
+}
+
+/*
+ * lat_bucket_top - Return the largest time counted in bucket b
+ */
+static uint64_t lat_bucket_top(int b)
+{
+    int e;
+
+    if (b < LAT_SUB)
+	return b;
+    e = b / LAT_SUB + LAT_SUB_BITS - 1;
+    return ((uint64_t)(LAT_SUB + b % LAT_SUB + 1) << (e - LAT_SUB_BITS)) - 1;
+}
+
+/*
+ * lat_percentile - Return the time in ns that fraction p of the
+ *     requests in h did not exceed, to within a bucket
+ */
+uint64_t lat_percentile(lat_hist_t *h, double p)
+{
+    uint64_t rank, seen = 0, top;
+    int b;
+
+    if (h->count == 0)
+	return 0;
+    rank = (uint64_t)(p * h->count);
+    if (rank < p * h->count || rank == 0)
+	rank++;
+    for (b = 0; b < LAT_BUCKETS; b++) {
+	seen += h->buckets[b];
+	if (seen >= rank)
+	    break;
+    }
+    top = lat_bucket_top(b);
+    return top < h->max ? top : h->max;
+}
+
+/*
+ * lat_print_row - Print the percentiles of one histogram
+ */
+static void lat_print_row(char *type, char *band, lat_hist_t *h)
+{
+    printf("%-8s%-7s%10lu%9lu%9lu%9lu%9lu%10lu\n", type, band,
+	   (unsigned long)h->count,
+	   (unsigned long)lat_percentile(h, 0.5),
+	   (unsigned long)lat_percentile(h, 0.9),
+	   (unsigned long)lat_percentile(h, 0.99),
+	   (unsigned long)lat_percentile(h, 0.999),
+	   (unsigned long)h->max);
+}
+
+/*
+ * lat_print - Print the percentiles of every nonempty histogram, and
+ *     of each request type over all size bands
+ */
+void lat_print(latency_t *lat)
+{
+    lat_hist_t all;
+    int t, b;
+
+    printf("%-8s%-7s%10s%9s%9s%9s%9s%10s\n", "op", "size", "count",
+	   "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+    for (t = 0; t < LAT_TYPES; t++) {
+	memset(&all, 0, sizeof(all));
+	for (b = 0; b < LAT_BANDS; b++) {
+	    if (lat->hist[t][b].count == 0)
+		continue;
+	    lat_print_row(lat_type_names[t], lat_band_names[b], &lat->hist[t][b]);
+	    lat_merge(&all, &lat->hist[t][b]);
+	}
+	if (all.count > 0)
+	    lat_print_row(lat_type_names[t], "all", &all);
+    }
+    printf("(clock overhead of %lu ns subtracted)\n",
+	   (unsigned long)lat->overhead);
+}
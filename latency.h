@@ -0,0 +1,105 @@
+#ifndef __LATENCY_H_
+#define __LATENCY_H_
+
+/*
+ * latency.h - per-request latency histograms
+ *
+ * Each request is timed on its own with the monotonic clock and the
+ * time is counted in a log-bucketed histogram, one per request type
+ * and size band. Every power of two is split into LAT_SUB buckets, so
+ * a percentile read from a histogram is at most 1/LAT_SUB too high.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define LAT_SUB_BITS 3                    /* log2 of buckets per power of 2 */
+#define LAT_SUB      (1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS 40                   /* times of 2^40 ns and up share
+					     the last bucket */
+#define LAT_BUCKETS  ((LAT_MAX_BITS - LAT_SUB_BITS + 1) * LAT_SUB)
+
+#define LAT_TYPES    3                    /* ALLOC, FREE, REALLOC */
+#define LAT_BANDS    5                    /* see lat_band */
+
+typedef struct {
+    uint64_t count;                  /* requests timed */
+    uint64_t max;                    /* slowest of them in ns */
+    uint64_t buckets[LAT_BUCKETS];
+} lat_hist_t;
+
+typedef struct {
+    uint64_t overhead;               /* ns taken by reading the clock,
+					subtracted from every sample */
+    lat_hist_t hist[LAT_TYPES][LAT_BANDS];
+} latency_t;
+
+/*
+ * lat_now - Return the monotonic clock in ns
+ */
+static inline uint64_t lat_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * lat_band - Return the size band of a request for size bytes
+ */
+static inline int lat_band(size_t size)
+{
+    if (size <= 64)
+	return 0;
+    if (size <= 512)
+	return 1;
+    if (size <= 4096)
+	return 2;
+    if (size <= 65536)
+	return 3;
+    return 4;
+}
+
+/*
+ * lat_bucket - Return the bucket that counts a time of ns
+ */
+static inline int lat_bucket(uint64_t ns)
+{
+    int e;
+
+    if (ns < LAT_SUB)
+	return ns;
+    if (ns >= (uint64_t)1 << LAT_MAX_BITS)
+	return LAT_BUCKETS - 1;
+    e = 63 - __builtin_clzll(ns);
+    return (e - LAT_SUB_BITS + 1) * LAT_SUB
+	+ ((ns >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/*
+ * lat_record - Count a request of type for size bytes that took the
+ *     ns between start and end
+ */
+static inline void lat_record(latency_t *lat, int type, size_t size,
+			      uint64_t start, uint64_t end)
+{
+    lat_hist_t *h = &lat->hist[type][lat_band(size)];
+    uint64_t ns = end - start;
+
+    ns = ns > lat->overhead ? ns - lat->overhead : 0;
+    h->count++;
+    h->buckets[lat_bucket(ns)]++;
+    if (ns > h->max)
+	h->max = ns;
+}
+
+extern char *lat_type_names[LAT_TYPES];  /* "malloc", "free", "realloc" */
+extern char *lat_band_names[LAT_BANDS];  /* "<=64" ... ">64K" */
+
+void lat_init(latency_t *lat);
+void lat_merge(lat_hist_t *into, lat_hist_t *h);
+uint64_t lat_percentile(lat_hist_t *h, double p);
+void lat_print(latency_t *lat);
+
+#endif /* __LATENCY_H_ */
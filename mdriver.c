@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -17,10 +18,28 @@
 #include <math.h>
 #include <inttypes.h>
 #include <time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "pagemap.h"
+#include "trace.h"
+#include "tstream.h"
+#include "latency.h"
+#include "timeline.h"
+#include "baseline.h"
+#include "perfctr.h"
+#include "replay.h"
+#include "gen.h"
+#include "profile.h"
+#include "alloc.h"
+#include "ftimer.h"
 #include "fsecs.h"
 #include "config.h"
 
@@ -36,6 +55,12 @@
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
+/* Number of range records carved from each pool chunk */
+#define RANGE_CHUNK 4096
+
+/* Initial number of slots in the id map of a stream trace */
+#define IDMAP_INIT_BITS 12
+
 /****************************** 
  * The key compound data types 
  *****************************/
@@ -44,26 +69,47 @@
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned prio;         /* random heap priority that balances the treap */
+    struct range_t *left;  /* ranges at lower addresses */
+    struct range_t *right; /* ranges at higher addresses (or next free) */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* A block of range records handed out by the range pool */
+typedef struct range_chunk_t {
+    struct range_chunk_t *next;
+    range_t nodes[RANGE_CHUNK];
+} range_chunk_t;
+
+/* 
+ * The set of live payload extents: a treap ordered by lo, whose
+ * records come from a pool of chunks that is reused across traces
+ */
+typedef struct {
+    range_t *root;         /* root of the treap */
+    range_t *free_nodes;   /* records released by remove_range */
+    range_chunk_t *chunks; /* all chunks in the pool */
+    range_chunk_t *chunk;  /* chunk currently being carved */
+    int used;              /* records carved from chunk so far */
+    unsigned seed;         /* state of the priority generator */
+} ranges_t;
+
+/* A live block of a stream trace, found by its id */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
+    uint64_t index;      /* id from the trace */
+    char *block;         /* payload returned by the allocator, NULL if empty */
+    size_t size;         /* payload size */
+} idslot_t;
 
-/* Holds the information for one trace file*/
+/* 
+ * Open-addressing hash table of the live blocks of a stream trace,
+ * which takes the place of the blocks and block_sizes arrays since
+ * a stream trace can have far more ids than fit in memory
+ */
 typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+    idslot_t *slots;
+    int bits;            /* log2 of the number of slots */
+    size_t count;        /* number of live blocks */
+} idmap_t;
 
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
@@ -71,21 +117,62 @@ typedef struct {
  * as input.
  */
 typedef struct {
+    allocator_t *alloc; /* allocator the trace is replayed on */
     trace_t *trace;  
-    range_t *ranges;
+    ranges_t *ranges;
+    char *stream;    /* path of a stream trace, replayed instead of trace */
+    idmap_t *ids;    /* live blocks of the stream trace */
+    uint64_t ops;    /* number of requests replayed from the stream */
+    int runs;        /* number of times the speed function ran */
+    long minflt;     /* minor page faults summed over those runs */
+    long majflt;     /* major page faults summed over those runs */
 } speed_t;
 
+/* One thread count of the multithreaded replay (-M) */
+#define MT_MAX_STEPS 8 /* 1, 2, 4, ..., 64 threads and the -M maximum */
+typedef struct {
+    int threads;     /* number of replay threads */
+    double ops;      /* requests replayed by all of them in one run */
+    double secs;     /* time of one run */
+    double thread_kops[REPLAY_MAX_THREADS]; /* each thread's own rate */
+} mt_stats_t;
+
+/* What the reallocs of a trace cost in the correctness run */
+typedef struct {
+    double count;    /* number of reallocs */
+    double inplace;  /* of them, the ones that returned the old pointer */
+    double copied;   /* bytes the others had to copy to the new block */
+    double secs;     /* time spent inside realloc */
+} realloc_stats_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
-    /* defined for both libc malloc and student malloc package (mm.c) */
+    /* defined for every allocator */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    int nsamples;    /* times of the individual timed runs... */
+    double samples[FSECS_MAX_SAMPLES];
+    double cv;       /* spread of all the timed runs, -1 if only one */
+
+    /* defined only for allocators with stats (always 0 for libc) */
+    double util;     /* overall space utilization for this trace */
+
+    double inst_util;     /* instanteous space utilization for this trace */
+
+    double minflt;   /* minor page faults per timed run */
+    double majflt;   /* major page faults per timed run */
+
+    mem_stats_t mem; /* memlib's kernel activity during the util run */
 
-    /* defined only for the student malloc package */
-    double util;     /* overall space utilization for this trace (always 0 for libc) */
+    /* defined for every allocator */
+    latency_t lat;   /* time of each request in a separate run (-L) */
+    perf_counts_t perf; /* hardware events of one more speed run (-e) */
+    realloc_stats_t re; /* reallocs of the correctness run */
 
-    double inst_util;     /* instanteous space utilization for this trace (always 0 for libc) */
+    /* defined when the trace is replayed by threads (-M) */
+    int nmt;         /* number of thread counts replayed */
+    mt_stats_t mt[MT_MAX_STEPS];
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -97,6 +184,49 @@ int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
+/* Parallel evaluation (-j, -s, -p) */
+static int jobs = 1;                       /* number of worker processes */
+static int serialize = 0;                  /* one timed run at a time */
+static int pin = 0;                        /* pin workers to separate CPUs */
+static pthread_mutex_t *timing_lock = NULL; /* held around timed runs */
+
+/* Isolation of the timed runs (-C, -w, -K, -R) */
+static int only_cpu = -1;   /* CPU the driver runs on, -1 for any */
+static int warmup = 0;      /* untimed runs before each set of timed runs */
+static int nice_value = 0;  /* priority set by -R, 0 if unchanged */
+
+/* Allocators to evaluate (-a, -l); the first is mm.c, which is scored */
+static allocator_t *allocs[ALLOC_MAX];
+static int nallocs = 0;
+static allocator_t *evaluated = NULL; /* the one being evaluated now */
+
+static int latency = 0; /* time each request in an extra run (-L) */
+static int perfctr = 0; /* count hardware events in an extra run (-e) */
+static int mt_threads = 0; /* replay with up to this many threads (-M) */
+
+/* Payload touching in the speed runs (-x) */
+#define TOUCH_NONE 0    /* never touch a payload */
+#define TOUCH_LINE 1    /* write and read the first cache line of a block */
+#define TOUCH_ALL  2    /* write every byte and read every line of a block */
+#define TOUCH_LINE_SIZE 64
+#define TOUCH_PERIOD 16 /* read some live block every this many requests */
+static int touch = TOUCH_NONE;
+static volatile unsigned char touch_sink; /* keeps the reads from going away */
+static char *timeline_path = NULL; /* fragmentation timelines go here (-F) */
+static double threshold = 5.0; /* % drop that counts as a regression (-r) */
+
+/* Format of the results (-o) */
+#define OUT_TEXT 0      /* tables for people */
+#define OUT_JSON 1      /* one JSON document */
+#define OUT_CSV  2      /* one CSV row per allocator and trace */
+static int output = OUT_TEXT;
+static int results_fd = -1;  /* the real stdout under -o json or csv */
+
+/* Compiler flags of this build, passed in by the Makefile */
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS "unknown"
+#endif
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -110,28 +240,78 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate the range set */
+static int add_range(ranges_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum);
-static void remove_range(range_t **ranges, char *lo);
-static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
-/* Routines for evaluating the correctness and speed of libc malloc */
-static int eval_libc_valid(trace_t *trace, int tracenum);
-static void eval_libc_speed(void *ptr);
-
-/* Routines for evaluating correctnes, space utilization, and speed 
-   of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio);
-static void eval_mm_speed(void *ptr);
+static void remove_range(ranges_t *ranges, char *lo);
+static void clear_ranges(ranges_t *ranges);
+
+/* Evaluates one trace, either in this process or in a -j worker */
+typedef void (*eval_trace_t)(char *filename, int tracenum, speed_t *params,
+			     stats_t *stats);
+static void eval_traces(int n, char **tracefiles, eval_trace_t eval,
+			speed_t *params, stats_t *stats);
+static trace_t *load_trace(char *filename);
+static void add_alloc(char *name);
+static void profile_trace(char *filename);
+static void eval_parallel(int n, char **tracefiles, eval_trace_t eval,
+			  speed_t *params, stats_t *stats);
+static void eval_trace(char *filename, int tracenum, speed_t *params,
+		       stats_t *stats);
+
+/* Routines for evaluating the correctness, space utilization, and
+   speed of an allocator */
+static int eval_valid(allocator_t *a, trace_t *trace, int tracenum,
+		      ranges_t *ranges, realloc_stats_t *re);
+static int check_realloc(char *oldp, size_t oldsize, char *newp,
+			 size_t newsize, int fill, uint64_t start,
+			 realloc_stats_t *re);
+static int check_usable(allocator_t *a, char *p, size_t size);
+static double eval_util(allocator_t *a, trace_t *trace, int tracenum,
+			double *inst_ratio, mem_stats_t *mem_stats);
+static void eval_trace_speed(void *ptr);
+static void eval_latency(allocator_t *a, trace_t *trace, latency_t *lat);
+
+/* Routines for replaying stream traces, which are too big to load */
+static void idmap_clear(idmap_t *ids);
+static idslot_t *idmap_get(idmap_t *ids, uint64_t index);
+static idslot_t *idmap_put(idmap_t *ids, uint64_t index);
+static void idmap_remove(idmap_t *ids, idslot_t *slot);
+static int eval_stream(allocator_t *a, char *path, int tracenum,
+		       ranges_t *ranges, stats_t *stats);
+static void eval_stream_speed(void *ptr);
+static void eval_stream_latency(allocator_t *a, char *path, idmap_t *ids,
+				latency_t *lat);
+
+/* Wrappers that time a speed function and record its page faults, and
+   count its hardware events */
+static double eval_speed(void (*f)(void *), speed_t *params, stats_t *stats);
+static void eval_perf(void (*f)(void *), speed_t *params, stats_t *stats);
+static void eval_threads(trace_t *trace, allocator_t *a, stats_t *stats);
+static void get_faults(long *minflt, long *majflt);
+static void run_on_cpu(int cpu);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printmemstats(int n, stats_t *stats);
+static void printrealloc(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printperf(int n, stats_t *stats);
+static void printthreads(int n, stats_t *stats);
+static void printalloc(int n, allocator_t *a, stats_t *stats);
+static void printcompare(int n, stats_t **stats);
+static void printcompare_cell(allocator_t *a, stats_t *st);
+static void printjson(int n, char **tracefiles, stats_t **stats,
+		      int numcorrect, double perfindex, double thru_share,
+		      double util_share);
+static void printcsv(int n, char **tracefiles, stats_t **stats,
+		     double perfindex);
+static void sum_stats(int n, stats_t *stats, stats_t *total);
+static void csv_quote(char *out, size_t n, char *s);
+static double ref_share(char *name, int n, stats_t **stats,
+			int *alloc_errors, int util, double *ref);
+static int printbaseline(int n, char **tracefiles, stats_t *stats,
+			 baseline_t *base);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -147,44 +327,163 @@ int main(int argc, char **argv)
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
-    stats_t *libc_stats = NULL;/* libc stats for each trace */
+    ranges_t ranges;           /* keeps track of block extents for one trace */
+    stats_t *stats[ALLOC_MAX]; /* stats of each allocator for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    int alloc_errors[ALLOC_MAX]; /* errors found in each allocator */
+    allocator_t *a;
+    char *p;
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    idmap_t ids;               /* live blocks of a stream trace */
 
-    int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int prefault = 0;    /* If set, map pages with MAP_POPULATE (-P) */
+    int profile = 0;     /* If set, only profile the traces (-A) */
+    int local_traces = 0; /* If set, -f traces are in the current dir */
+    char *convert_to = NULL; /* If set, write the trace here in binary (-c) */
+    char *stream_to = NULL;  /* If set, write the trace here as a stream (-z) */
+    char *baseline = NULL;   /* If set, compare with the results here (-b) */
+    baseline_t *base = NULL;
+    int regressions = 0;
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, inst_util, avg_mm_inst_util, avg_mm_util, avg_mm_throughput;
     double p1, p1i, p2, perfindex;
-    int numcorrect;
+    double thru_share, util_share, bump_thru, oracle_util;
+    int numcorrect, k;
     
+    add_alloc("mm");
+
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVglPc:z:j:spLo:F:b:r:T:eM:G:x:AC:w:K:Ra:B")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
 	    break;
-        case 'f': /* Use one specific trace file only (relative to curr dir) */
-            num_tracefiles = 1;
-            if ((tracefiles = realloc(tracefiles, 2*sizeof(char *))) == NULL)
+        case 'f': /* Add a specific trace file (relative to curr dir) */
+            if ((tracefiles = realloc(tracefiles,
+				      (num_tracefiles+2)*sizeof(char *))) == NULL)
 		unix_error("ERROR: realloc failed in main");
 	    strcpy(tracedir, "./"); 
-            tracefiles[0] = strdup(optarg);
-            tracefiles[1] = NULL;
+	    local_traces = 1;
+            tracefiles[num_tracefiles] = strdup(optarg);
+            tracefiles[++num_tracefiles] = NULL;
+            break;
+        case 'G': /* Add a trace generated in memory from a spec */
+            if ((tracefiles = realloc(tracefiles,
+				      (num_tracefiles+2)*sizeof(char *))) == NULL
+		|| (tracefiles[num_tracefiles] =
+		    malloc(strlen(GEN_PREFIX) + strlen(optarg) + 1)) == NULL)
+		unix_error("ERROR: realloc failed in main");
+	    sprintf(tracefiles[num_tracefiles], "%s%s", GEN_PREFIX, optarg);
+            tracefiles[++num_tracefiles] = NULL;
             break;
 	case 't': /* Directory where the traces are located */
-	    if (num_tracefiles == 1) /* ignore if -f already encountered */
+	    if (local_traces) /* ignore if -f already encountered */
 		break;
 	    strcpy(tracedir, optarg);
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 'A': /* Profile the traces instead of running them */
+            profile = 1;
+            break;
         case 'l': /* Run libc malloc */
-            run_libc = 1;
+            add_alloc("libc");
+            break;
+        case 'a': /* Run these allocators as well */
+            for (p = strtok(optarg, ","); p != NULL; p = strtok(NULL, ","))
+		add_alloc(p);
+            break;
+        case 'B': /* Run the reference allocators that bound the score */
+            add_alloc("bump");
+            add_alloc("oracle");
+            break;
+        case 'P': /* Pre-fault pages returned by mem_map */
+            prefault = 1;
+            break;
+        case 'c': /* Convert the -f trace to the binary format */
+            convert_to = optarg;
+            break;
+        case 'z': /* Convert the -f trace to the stream format */
+            stream_to = optarg;
+            break;
+        case 'j': /* Evaluate traces in this many worker processes */
+            jobs = atoi(optarg);
+            if (jobs < 1)
+		app_error("ERROR: -j needs a positive number of jobs");
+            break;
+        case 's': /* Let only one worker at a time run timed runs */
+            serialize = 1;
+            break;
+        case 'p': /* Pin each worker to its own CPU */
+            pin = 1;
+            break;
+        case 'L': /* Time each mm request in an extra run */
+            latency = 1;
+            break;
+        case 'e': /* Count hardware events in an extra run */
+            perfctr = 1;
+            break;
+        case 'M': /* Replay with 1, 2, 4, ... up to this many threads */
+            mt_threads = atoi(optarg);
+            if (mt_threads < 1 || mt_threads > REPLAY_MAX_THREADS) {
+		sprintf(msg, "ERROR: -M takes 1 to %d threads",
+			REPLAY_MAX_THREADS);
+		app_error(msg);
+	    }
+            break;
+        case 'x': /* Touch payloads in the speed runs */
+            if (strcmp(optarg, "line") == 0)
+		touch = TOUCH_LINE;
+            else if (strcmp(optarg, "all") == 0)
+		touch = TOUCH_ALL;
+            else
+		app_error("ERROR: -x takes line or all");
+            break;
+        case 'C': /* Run on this CPU only */
+            only_cpu = atoi(optarg);
+            if (only_cpu < 0 || only_cpu >= CPU_SETSIZE)
+		app_error("ERROR: -C takes a CPU number");
+            break;
+        case 'w': /* Untimed runs before the timed ones */
+            warmup = atoi(optarg);
+            if (warmup < 0)
+		app_error("ERROR: -w takes a number of runs");
+            fsecs_set_warmup(warmup);
+            break;
+        case 'K': /* Flush this many KB of cache before each timed run */
+            if (atol(optarg) < 0)
+		app_error("ERROR: -K takes a size in KB");
+            fsecs_set_flush(atol(optarg) * 1024);
+            break;
+        case 'R': /* Raise the scheduling priority */
+            nice_value = -20;
+            break;
+        case 'T': /* Measure with this timer */
+            if (!fsecs_set_timer(optarg))
+		app_error("ERROR: -T takes tsc, monotonic, gettod or itimer");
+            break;
+        case 'b': /* Compare with a baseline saved by -o csv */
+            baseline = optarg;
+            break;
+        case 'r': /* Regression threshold in percent */
+            threshold = atof(optarg);
+            break;
+        case 'F': /* Write a fragmentation timeline of each trace */
+            timeline_path = optarg;
+            break;
+        case 'o': /* Print the results as JSON or CSV */
+            if (strcmp(optarg, "json") == 0)
+		output = OUT_JSON;
+            else if (strcmp(optarg, "csv") == 0)
+		output = OUT_CSV;
+            else if (strcmp(optarg, "text") == 0)
+		output = OUT_TEXT;
+            else
+		app_error("ERROR: -o takes json, csv or text");
             break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
@@ -200,6 +499,18 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+
+    /*
+     * Under -o json or csv, stdout carries the results alone. Until
+     * they are printed, it goes to stderr, along with the messages
+     * and tables of the driver, the traces and the allocators.
+     */
+    if (output != OUT_TEXT) {
+	fflush(stdout);
+	if ((results_fd = dup(STDOUT_FILENO)) < 0
+	    || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+	    unix_error("ERROR: dup failed in main");
+    }
 	
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
@@ -208,87 +519,107 @@ int main(int argc, char **argv)
     if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
-	printf("Using default tracefiles in %s\n", tracedir);
+	if (output == OUT_TEXT)
+	    printf("Using default tracefiles in %s\n", tracedir);
     }
 
-    /* Initialize the timing package */
-    init_fsecs();
-
-    /*
-     * Optionally run and evaluate the libc malloc package 
+    /* 
+     * If -c or -z was given, just convert the -f trace to the binary
+     * or stream format
      */
-    if (run_libc) {
-	if (verbose > 1)
-	    printf("\nTesting libc malloc\n");
-	
-	/* Allocate libc stats array, with one stats_t struct per tracefile */
-	libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-	if (libc_stats == NULL)
-	    unix_error("libc_stats calloc in main failed");
-	
-	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+    if (convert_to != NULL || stream_to != NULL) {
+	if (num_tracefiles != 1)
+	    app_error("ERROR: -c and -z need a single trace given with -f or -G");
+	trace = load_trace(tracefiles[0]);
+	if (convert_to != NULL)
+	    write_trace_bin(trace, convert_to);
+	else
+	    write_trace_stream(trace, stream_to);
+	if (verbose)
+	    printf("Wrote %d requests to %s\n", trace->num_ops,
+		   convert_to != NULL ? convert_to : stream_to);
+	free_trace(trace);
+	exit(0);
+    }
 
-	/* Display the libc results in a compact table */
-	if (verbose) {
-	    printf("\nResults for libc malloc:\n");
-	    printresults(num_tracefiles, libc_stats);
+    /* With -A, just profile the traces */
+    if (profile) {
+	for (i = 0; i < num_tracefiles; i++) {
+	    printf("%sProfile of %s:\n", i ? "\n" : "", tracefiles[i]);
+	    profile_trace(tracefiles[i]);
 	}
+	exit(0);
     }
 
-    /*
-     * Always run and evaluate the student's mm package
-     */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
+    /* Load the baseline before spending time on the traces */
+    if (baseline != NULL)
+	base = base_load(baseline);
+
+    /* Keep other work off the timed runs */
+    if (only_cpu >= 0)
+	run_on_cpu(only_cpu);
+    if (nice_value && setpriority(PRIO_PROCESS, 0, nice_value) < 0) {
+	if (output == OUT_TEXT)
+	    printf("Could not raise the priority: %s\n", strerror(errno));
+	nice_value = 0;
+    }
+
+    /* Initialize the timing package */
+    init_fsecs();
+    memset(&ids, 0, sizeof(ids));
+    speed_params.ids = &ids;
+
+    if (perfctr && perf_available() == 0) {
+	if (output == OUT_TEXT)
+	    printf("Hardware counters are unavailable: %s\n",
+		   perf_why_unavailable());
+	perfctr = 0;
+    }
+
+    if (prefault) {
+	if (verbose)
+	    printf("Pre-faulting pages returned by mem_map.\n");
+	mem_set_prefault(1);
+    }
 
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
-	unix_error("mm_stats calloc in main failed");
-    
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
+    memset(&ranges, 0, sizeof(ranges));
+    speed_params.ranges = &ranges;
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
+    /*
+     * Evaluate each allocator with the K-best scheme, starting with
+     * the student's mm package
+     */
+    for (k = 0; k < nallocs; k++) {
+	a = allocs[k];
 	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges, &mm_stats[i].inst_util);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+	    printf("\nTesting %s\n", a->desc);
+
+	/* Allocate its stats array, with one stats_t struct per tracefile */
+	stats[k] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (stats[k] == NULL)
+	    unix_error("stats calloc in main failed");
+
+	speed_params.alloc = evaluated = a;
+	errors = 0;
+	eval_traces(num_tracefiles, tracefiles, eval_trace,
+		    &speed_params, stats[k]);
+	alloc_errors[k] = errors;
+	printalloc(num_tracefiles, a, stats[k]);
     }
-
-    /* Display the mm results in a compact table */
-    if (verbose) {
-	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
+    errors = alloc_errors[0];
+    mm_stats = stats[0];
+    if (nallocs > 1 && output == OUT_TEXT) {
+	printf("\nComparison of the allocators (Kops, util):\n");
+	printcompare(num_tracefiles, stats);
 	printf("\n");
     }
+    if (base != NULL) {
+	regressions = printbaseline(num_tracefiles, tracefiles, mm_stats,
+				    base);
+	base_free(base);
+    }
 
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
@@ -326,44 +657,132 @@ int main(int argc, char **argv)
 	}
 	
 	perfindex = (p1 + p1i + p2)*100.0;
-	printf("Perf index = %.0f (util) + %.0f (util_i) + %.0f (thru) = %.0f/100\n",
+	if (output == OUT_TEXT)
+	    printf("Perf index = %.0f (util) + %.0f (util_i) + %.0f (thru) = %.0f/100\n",
 	       p1*100, 
 	       p1i*100, 
 	       p2*100,
 	       perfindex);
-	
+
+	/* How close mm.c comes to the bounds on this machine (-B) */
+	thru_share = ref_share("bump", num_tracefiles, stats, alloc_errors,
+			       0, &bump_thru);
+	util_share = ref_share("oracle", num_tracefiles, stats, alloc_errors,
+			       1, &oracle_util);
+	if (output == OUT_TEXT && thru_share >= 0)
+	    printf("Thru = %.1f%% of the bump allocator's %.0f Kops\n",
+		   thru_share*100, bump_thru/1e3);
+	if (output == OUT_TEXT && util_share >= 0)
+	    printf("Util = %.0f%% of the oracle's %.0f%%\n",
+		   util_share*100, oracle_util*100);
     }
     else { /* There were errors */
 	perfindex = 0.0;
-	printf("Terminated with %d errors\n", errors);
+	thru_share = util_share = -1;
+	if (output == OUT_TEXT)
+	    printf("Terminated with %d errors\n", errors);
+    }
+
+    if (results_fd >= 0) {
+	fflush(stdout);
+	if (dup2(results_fd, STDOUT_FILENO) < 0)
+	    unix_error("ERROR: dup2 failed in main");
     }
+    if (output == OUT_JSON)
+	printjson(num_tracefiles, tracefiles, stats, numcorrect, perfindex,
+		  thru_share, util_share);
+    else if (output == OUT_CSV)
+	printcsv(num_tracefiles, tracefiles, stats, perfindex);
 
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /* A regression against the baseline is a distinct failure */
+    exit(regressions ? 2 : 0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range set, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range set to detect any overlapping allocated blocks. The set is a
+ * treap keyed by the low address, so each check or update takes
+ * O(log n) expected time for n live blocks.
  ****************************************************************/
 
+/*
+ * new_range - Take a range record from the pool
+ */
+static range_t *new_range(ranges_t *ranges)
+{
+    range_t *p;
+    range_chunk_t *c;
+
+    if ((p = ranges->free_nodes) != NULL) {
+	ranges->free_nodes = p->right;
+	return p;
+    }
+
+    if (ranges->chunk == NULL || ranges->used == RANGE_CHUNK) {
+	c = ranges->chunk ? ranges->chunk->next : ranges->chunks;
+	if (c == NULL) {
+	    if ((c = (range_chunk_t *)malloc(sizeof(range_chunk_t))) == NULL)
+		unix_error("malloc error in new_range");
+	    c->next = NULL;
+	    if (ranges->chunk)
+		ranges->chunk->next = c;
+	    else
+		ranges->chunks = c;
+	}
+	ranges->chunk = c;
+	ranges->used = 0;
+    }
+    return &ranges->chunk->nodes[ranges->used++];
+}
+
+/*
+ * insert_range - Insert p below *rootp, rotating it up while its
+ *     priority beats its parent's
+ */
+static void insert_range(range_t **rootp, range_t *p)
+{
+    range_t *t = *rootp;
+
+    if (t == NULL) {
+	*rootp = p;
+	return;
+    }
+    if (p->lo < t->lo) {
+	insert_range(&t->left, p);
+	if (t->left->prio > t->prio) {
+	    *rootp = t->left;
+	    t->left = (*rootp)->right;
+	    (*rootp)->right = t;
+	}
+    }
+    else {
+	insert_range(&t->right, p);
+	if (t->right->prio > t->prio) {
+	    *rootp = t->right;
+	    t->right = (*rootp)->left;
+	    (*rootp)->left = t;
+	}
+    }
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range set. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(ranges_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *pred, *succ;
     char msg[MAXLINE];
     size_t page_size = mem_pagesize(), i;
 
@@ -377,8 +796,8 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
     
-    /* The payload must lie on a mapped page */
-    for (i = 0; i < size; i += page_size) {
+    /* The payload must lie on a page that memlib mapped */
+    for (i = 0; evaluated->memlib && i < size; i += page_size) {
       if (!pagemap_is_mapped(lo+i)) {
 	sprintf(msg, "Payload (%p:%p) includes an unmapped page",
 		lo, hi);
@@ -386,182 +805,378 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
       }
     }
-    if (!pagemap_is_mapped(lo+size-1)) {
+    if (evaluated->memlib && !pagemap_is_mapped(lo+size-1)) {
       sprintf(msg, "Payload (%p:%p) ends at an unmapped page",
               lo, hi);
       malloc_error(tracenum, opnum, msg);
       return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. Since the
+     * payloads in the set are disjoint, only the last one starting at
+     * or below lo and the first one starting above it can overlap.
+     */
+    pred = succ = NULL;
+    for (p = ranges->root;  p != NULL; ) {
+	if (p->lo <= lo) {
+	    pred = p;
+	    p = p->right;
+	}
+	else {
+	    succ = p;
+	    p = p->left;
+	}
+    }
+    if (pred != NULL && pred->hi >= lo)
+	p = pred;
+    else if (succ != NULL && succ->lo <= hi)
+	p = succ;
+    else
+	p = NULL;
+    if (p != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by taking a range struct from the pool and adding it the range set.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = new_range(ranges);
+    ranges->seed = ranges->seed * 1103515245 + 12345;
+    p->prio = ranges->seed;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->left = p->right = NULL;
+    insert_range(&ranges->root, p);
     return 1;
 }
 
 /* 
  * remove_range - Free the range record of block whose payload starts at lo 
  */
-static void remove_range(range_t **ranges, char *lo)
+static void remove_range(ranges_t *ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    range_t **pp = &ranges->root;
+    range_t *p, *l, *r;
+
+    while ((p = *pp) != NULL && p->lo != lo)
+	pp = (lo < p->lo) ? &p->left : &p->right;
+    if (p == NULL)
+	return;
+
+    /* Rotate p down until it has at most one child, then splice it out */
+    while (p->left != NULL && p->right != NULL) {
+	l = p->left;
+	r = p->right;
+	if (l->prio > r->prio) {
+	    p->left = l->right;
+	    l->right = p;
+	    *pp = l;
+	    pp = &l->right;
+	}
+	else {
+	    p->right = r->left;
+	    r->left = p;
+	    *pp = r;
+	    pp = &r->left;
+	}
     }
+    *pp = p->left ? p->left : p->right;
+
+    p->right = ranges->free_nodes;
+    ranges->free_nodes = p;
 }
 
 /*
- * clear_ranges - free all of the range records for a trace 
+ * clear_ranges - return all of the range records for a trace to the pool
  */
-static void clear_ranges(range_t **ranges)
+static void clear_ranges(ranges_t *ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    ranges->root = NULL;
+    ranges->free_nodes = NULL;
+    ranges->chunk = NULL;
+    ranges->used = 0;
+}
+
+
+/**********************************************************************
+ * The following functions evaluate whole traces, one after another or
+ * in parallel worker processes (-j). Each worker is a fork of the
+ * driver, so it owns its own copy of the memlib and pagemap state, and
+ * it writes each trace's stats into a shared mapping.
+ **********************************************************************/
+
+/*
+ * eval_traces - Evaluate the n traces in tracefiles with eval and
+ *     store their stats in stats
+ */
+static void eval_traces(int n, char **tracefiles, eval_trace_t eval,
+			speed_t *params, stats_t *stats)
+{
+    int i;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    if (jobs > 1 && n > 1) {
+	eval_parallel(n, tracefiles, eval, params, stats);
+	return;
     }
-    *ranges = NULL;
+    for (i=0; i < n; i++)
+	eval(tracefiles[i], i, params, &stats[i]);
 }
 
-
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+/* State shared by the parent and the workers of eval_parallel */
+typedef struct {
+    pthread_mutex_t timing;   /* serializes timed runs under -s */
+    atomic_int next;          /* next trace to hand out */
+    atomic_int errors;        /* errors found by all workers */
+} shared_t;
 
 /*
- * read_trace - read a trace file and store it in memory
+ * run_on_cpu - Let this process run on CPU cpu only
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static void run_on_cpu(int cpu)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    cpu_set_t mine;
 
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
+    CPU_ZERO(&mine);
+    CPU_SET(cpu, &mine);
+    if (sched_setaffinity(0, sizeof(mine), &mine) < 0)
+	unix_error("sched_setaffinity failed");
+}
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
+/*
+ * pin_to_cpu - Pin this process to the k-th CPU it may run on
+ */
+static void pin_to_cpu(int k)
+{
+    cpu_set_t allowed;
+    int cpu, ncpus;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+	unix_error("sched_getaffinity failed");
+    ncpus = CPU_COUNT(&allowed);
+    k %= ncpus;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	if (CPU_ISSET(cpu, &allowed) && k-- == 0)
 	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
+    run_on_cpu(cpu);
+}
+
+/*
+ * eval_parallel - Evaluate the traces in jobs worker processes, which
+ *     take the next unevaluated trace until none are left
+ */
+static void eval_parallel(int n, char **tracefiles, eval_trace_t eval,
+			  speed_t *params, stats_t *stats)
+{
+    shared_t *shared;
+    stats_t *shared_stats;
+    pthread_mutexattr_t attr;
+    pid_t *pids;
+    int i, k, status;
+    size_t len = sizeof(shared_t) + n * sizeof(stats_t);
+
+    shared = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+	unix_error("mmap failed in eval_parallel");
+    shared_stats = (stats_t *)(shared + 1);
+    atomic_init(&shared->next, 0);
+    atomic_init(&shared->errors, 0);
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&shared->timing, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    if ((pids = calloc(jobs, sizeof(pid_t))) == NULL)
+	unix_error("calloc failed in eval_parallel");
+
+    /* Don't let the workers inherit (and print again) pending output */
+    fflush(stdout);
+
+    for (k = 0; k < jobs; k++) {
+	if ((pids[k] = fork()) < 0)
+	    unix_error("fork failed in eval_parallel");
+	if (pids[k] == 0) {
+	    if (pin)
+		pin_to_cpu(k);
+	    if (serialize)
+		timing_lock = &shared->timing;
+	    errors = 0;
+	    while ((i = atomic_fetch_add(&shared->next, 1)) < n)
+		eval(tracefiles[i], i, params, &shared_stats[i]);
+	    atomic_fetch_add(&shared->errors, errors);
+	    fflush(stdout);
+	    _exit(0);
 	}
-	op_index++;
-	
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+
+    for (k = 0; k < jobs; k++) {
+	if (waitpid(pids[k], &status, 0) < 0)
+	    unix_error("waitpid failed in eval_parallel");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	    /* The traces it was working on are left invalid */
+	    errors++;
+	    printf("ERROR: worker %d died (%s %d)\n", k,
+		   WIFSIGNALED(status) ? "signal" : "status",
+		   WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+	}
+    }
+
+    errors += atomic_load(&shared->errors);
+    memcpy(stats, shared_stats, n * sizeof(stats_t));
+    pthread_mutex_destroy(&shared->timing);
+    munmap(shared, len);
+    free(pids);
+}
+
+/*
+ * add_alloc - Add the allocator called name to those evaluated, unless
+ *     it is there already
+ */
+static void add_alloc(char *name)
+{
+    allocator_t *a;
+    int k;
+
+    if ((a = alloc_find(name)) == NULL) {
+	sprintf(msg, "ERROR: there is no allocator %s; try %s", name,
+		alloc_names());
+	app_error(msg);
+    }
+    for (k = 0; k < nallocs; k++)
+	if (allocs[k] == a)
+	    return;
+    if (nallocs == ALLOC_MAX)
+	app_error("ERROR: too many allocators");
+    allocs[nallocs++] = a;
+}
+
+/*
+ * load_trace - Read a trace file from the trace directory, or
+ *     generate the trace if its name is a generator spec (-G)
+ */
+static trace_t *load_trace(char *filename)
+{
+    if (gen_is_spec(filename))
+	return gen_trace(filename);
+    return read_trace(tracedir, filename);
+}
+
+/*
+ * profile_trace - Print the profile of one trace. A stream trace is
+ *     decoded a chunk at a time, a text trace is profiled line by line
+ *     as it is parsed, and a binary trace is read through its mapping,
+ *     so none of them needs to fit in memory.
+ */
+static void profile_trace(char *filename)
+{
+    prof_t *prof;
+    trace_t *trace;
+    trace_reader_t *r;
+    traceop_t op;
+    tstream_t *s;
+    tstream_op_t *ops;
+    char path[MAXLINE];
+    int i, n;
+
+    sprintf(path, "%s%s", tracedir, filename);
+    if (!gen_is_spec(filename) && tstream_is_stream(path)) {
+	s = tstream_open(path);
+	prof = prof_new(tstream_header(s)->num_ops);
+	while ((n = tstream_next(s, &ops)) > 0)
+	    for (i = 0; i < n; i++)
+		prof_op(prof, ops[i].type, ops[i].index, ops[i].size);
+	tstream_close(s);
+    }
+    else if (!gen_is_spec(filename) && !trace_is_bin(path)) {
+	r = trace_reader_open(path, &n);
+	prof = prof_new(n);
+	while (trace_reader_next(r, &op))
+	    prof_op(prof, op.type, op.index, op.size);
+	trace_reader_close(r);
+    }
+    else {
+	trace = load_trace(filename);
+	prof = prof_new(trace->num_ops);
+	for (i = 0; i < trace->num_ops; i++)
+	    prof_op(prof, trace->ops[i].type, trace->ops[i].index,
+		    trace->ops[i].size);
+	free_trace(trace);
+    }
+    prof_print(prof);
+    prof_free(prof);
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * eval_trace - Evaluate the allocator in params on one trace
  */
-void free_trace(trace_t *trace)
+static void eval_trace(char *filename, int tracenum, speed_t *params,
+		       stats_t *stats)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    allocator_t *a = params->alloc;
+    trace_t *trace;
+    char path[MAXLINE];
+
+    sprintf(path, "%s%s", tracedir, filename);
+    if (tstream_is_stream(path)) {
+	if (verbose > 1)
+	    printf("Streaming %s for correctness and efficiency, ", a->desc);
+	stats->valid = eval_stream(a, path, tracenum, params->ranges, stats);
+	if (stats->valid) {
+	    if (verbose > 1)
+		printf("and performance.\n");
+	    params->trace = NULL;
+	    params->stream = path;
+	    stats->secs = eval_speed(eval_stream_speed, params, stats);
+	    if (latency)
+		eval_stream_latency(a, path, params->ids, &stats->lat);
+	    if (perfctr)
+		eval_perf(eval_stream_speed, params, stats);
+	}
+	return;
+    }
+    trace = load_trace(filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking %s for correctness, ", a->desc);
+    stats->valid = eval_valid(a, trace, tracenum, params->ranges, &stats->re);
+    if (stats->valid) {
+	if (a->stats) {
+	    if (verbose > 1)
+		printf("efficiency, ");
+	    stats->util = eval_util(a, trace, tracenum, &stats->inst_util,
+				    &stats->mem);
+	}
+	params->trace = trace;
+	params->stream = NULL;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = eval_speed(eval_trace_speed, params, stats);
+	if (latency)
+	    eval_latency(a, trace, &stats->lat);
+	if (perfctr)
+	    eval_perf(eval_trace_speed, params, stats);
+	if (mt_threads)
+	    eval_threads(trace, a, stats);
+    }
+    free_trace(trace);
 }
 
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
+ * and throughput of an allocator.
  **********************************************************************/
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * eval_valid - Check the allocator a for correctness, and account for
+ *     its reallocs in re
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int eval_valid(allocator_t *a, trace_t *trace, int tracenum,
+		      ranges_t *ranges, realloc_stats_t *re)
 {
     int i;
     int index;
@@ -569,13 +1184,16 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *newp;
     char *oldp;
     char *p;
+    uint64_t start;
+    
+    memset(re, 0, sizeof(*re));
     
     /* Reset the heap and free any records in the range list */
     clear_ranges(ranges);
 
-    /* Call the mm package's init function */
-    if (mm_init() < 0) {
-	malloc_error(tracenum, 0, "mm_init failed.");
+    /* Call the allocator's init function */
+    if (a->init() < 0) {
+	malloc_error(tracenum, 0, "init failed.");
 	return 0;
     }
 
@@ -586,11 +1204,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_malloc */
+        case ALLOC: /* malloc */
 
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+	    /* Call the allocator's malloc */
+	    if ((p = a->malloc(size)) == NULL) {
+		malloc_error(tracenum, i, "malloc failed.");
 		return 0;
 	    }
 	    
@@ -601,6 +1219,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
 		return 0;
+	    if (!check_usable(a, p, size)) {
+		malloc_error(tracenum, i, "usable size is less than the request.");
+		return 0;
+	    }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
@@ -614,12 +1236,18 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    trace->block_sizes[index] = size;
 	    break;
 
-        case REALLOC: /* mm_malloc + mm_free */
+        case REALLOC: /* realloc */
 	    
-	    /* Call the student's realloc */
+	    /* Call the allocator's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+	    start = lat_now();
+	    if ((newp = a->realloc(oldp, size)) == NULL) {
+		malloc_error(tracenum, i, "realloc failed.");
+		return 0;
+	    }
+	    if (!check_realloc(oldp, trace->block_sizes[index], newp, size,
+			       index & 0xFF, start, re)) {
+		malloc_error(tracenum, i, "realloc lost the old contents.");
 		return 0;
 	    }
 
@@ -629,38 +1257,71 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Check new block for correctness and add it to range list */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
+	    if (!check_usable(a, newp, size)) {
+		malloc_error(tracenum, i, "usable size is less than the request.");
+		return 0;
+	    }
 
 	    memset(newp, index & 0xFF, size);
 
-            mm_free(oldp);
-
 	    /* Remember region */
 	    trace->blocks[index] = newp;
 	    trace->block_sizes[index] = size;
 	    break;
 
-        case FREE: /* mm_free */
+        case FREE: /* free */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* Remove region from list and call the allocator's free */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    a->free(p);
 	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in eval_valid");
         }
 
     }
 
-    mem_reset();
-
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
 
+/*
+ * check_realloc - Account in re for a realloc of oldp to newp that
+ *     started at start (lat_now), and check that the new block begins
+ *     with the old one's fill byte up to the smaller of the two sizes.
+ *     Returns 0 if it does not.
+ */
+static int check_realloc(char *oldp, size_t oldsize, char *newp,
+			 size_t newsize, int fill, uint64_t start,
+			 realloc_stats_t *re)
+{
+    size_t i, n = (oldsize < newsize) ? oldsize : newsize;
+
+    re->secs += (lat_now() - start) / 1e9;
+    re->count++;
+    if (newp == oldp)
+	re->inplace++;
+    else
+	re->copied += n;
+    for (i = 0; i < n; i++)
+	if ((unsigned char)newp[i] != fill)
+	    return 0;
+    return 1;
+}
+
+/*
+ * check_usable - Return whether the allocator a says that the block p
+ *     has room for the size bytes requested, or cannot tell
+ */
+static int check_usable(allocator_t *a, char *p, size_t size)
+{
+    return a->usable_size == NULL || a->usable_size(p) >= size;
+}
+
 /* 
- * eval_mm_util - Evaluate the space utilization of the student's package
+ * eval_util - Evaluate the space utilization of the allocator a
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
@@ -668,9 +1329,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
- *   
+ *   The run also records memlib's kernel activity in mem_stats.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio)
+static double eval_util(allocator_t *a, trace_t *trace, int tracenum,
+			double *inst_ratio, mem_stats_t *mem_stats)
 {   
     int i;
     int index;
@@ -681,20 +1343,26 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
     int ratio_exp;
     char *p;
     char *newp, *oldp;
+    alloc_stats_t st;
+    timeline_t tl;
+    int timeline = timeline_path && a == allocs[0];
+
+    if (timeline)
+	tl_init(&tl, TL_POINTS);
 
-    /* initialize the heap and the mm malloc package */
-    if (mm_init() < 0)
-	app_error("mm_init failed in eval_mm_util");
+    /* initialize the heap and the allocator */
+    if (a->init() < 0)
+	app_error("init failed in eval_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_alloc */
+        case ALLOC: /* malloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
-		app_error("mm_malloc failed in eval_mm_util");
+	    if ((p = a->malloc(size)) == NULL) 
+		app_error("malloc failed in eval_util");
 	    
 	    /* Remember region and size */
 	    trace->blocks[index] = p;
@@ -706,16 +1374,14 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
 
             break;
 
-	case REALLOC: /* mm_mealloc + mm_free */
+	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_malloc(newsize)) == NULL)
-		app_error("mm_realloc failed in eval_mm_util");
-
-            mm_free(oldp);
+	    if ((newp = a->realloc(oldp, newsize)) == NULL)
+		app_error("realloc failed in eval_util");
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -727,12 +1393,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
             
 	    break;
 
-        case FREE: /* mm_free */
+        case FREE: /* free */
 	    index = trace->ops[i].index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    a->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -741,7 +1407,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
 	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_util");
+	    app_error("Nonexistent request type in eval_util");
 
         }
 
@@ -751,7 +1417,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
                           total_size
                           : max_total_size);
 
-        heap_size = mem_heapsize();
+        a->stats(&st);
+        heap_size = st.heap;
         if (heap_size > max_heap_size)
           max_heap_size = heap_size;
 
@@ -765,10 +1432,16 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
         accum_ratio_frac = frexp(accum_ratio_frac, &ratio_exp);
         accum_ratio_exp += ratio_exp;
         
-        // printf("%ld %ld %f\n", total_size, heap_size, ratio);
+        if (timeline)
+	    tl_add(&tl, i, total_size, heap_size, st.mappings);
     }
 
-    mem_reset();
+    *mem_stats = st.mem;
+
+    if (timeline) {
+	tl_write(&tl, timeline_path, tracenum);
+	tl_free(&tl);
+    }
 
     ratio = accum_ratio_frac * pow(2, accum_ratio_exp / trace->num_ops);
 
@@ -781,140 +1454,665 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
 
 
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * touch_write - Write a new block, as a program that fills it would
  */
-static void eval_mm_speed(void *ptr)
+static inline void touch_write(char *p, size_t size)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
-
-    /* Reset the heap and initialize the mm package */
-    if (mm_init() < 0) 
-	app_error("mm_init failed in eval_mm_speed");
+    if (touch == TOUCH_LINE && size > TOUCH_LINE_SIZE)
+	size = TOUCH_LINE_SIZE;
+    memset(p, 0x5a, size);
+}
 
-    /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+/*
+ * touch_read - Read a live block, one byte per cache line
+ */
+static inline void touch_read(char *p, size_t size)
+{
+    unsigned char sum = 0;
+    size_t i;
+
+    if (touch == TOUCH_LINE && size > TOUCH_LINE_SIZE)
+	size = TOUCH_LINE_SIZE;
+    for (i = 0; i < size; i += TOUCH_LINE_SIZE)
+	sum += p[i];
+    touch_sink += sum;
+}
 
-        case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-		app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
-            break;
+/*
+ * touch_op - Touch the payloads around request i of trace, which has
+ *    just been made: write a new block, read a block about to be freed,
+ *    and every TOUCH_PERIOD requests read another live block. Freed
+ *    ids are cleared in trace->blocks after the free, so live blocks
+ *    can be found.
+ */
+static void touch_op(trace_t *trace, int i, int before)
+{
+    traceop_t *op = &trace->ops[i];
+    int id;
 
-	case REALLOC: /* mm_malloc + mm_free */
-	    index = trace->ops[i].index;
+    if (before) {
+	if (op->type == FREE)
+	    touch_read(trace->blocks[op->index], trace->block_sizes[op->index]);
+	return;
+    }
+    if (op->type == FREE)
+	trace->blocks[op->index] = NULL;  /* only once it has been freed */
+    else {
+	trace->block_sizes[op->index] = op->size;
+	touch_write(trace->blocks[op->index], op->size);
+    }
+    if (i % TOUCH_PERIOD == 0) {
+	id = (int)(((unsigned)i * 2654435761u) % trace->num_ids);
+	if (trace->blocks[id] != NULL)
+	    touch_read(trace->blocks[id], trace->block_sizes[id]);
+    }
+}
+
+/*
+ * eval_trace_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the allocator in params.
+ */
+static void eval_trace_speed(void *ptr)
+{
+    int i, index, size, newsize;
+    char *p, *newp, *oldp, *block;
+    speed_t *params = (speed_t *)ptr;
+    trace_t *trace = params->trace;
+    allocator_t *a = params->alloc;
+    long minflt, majflt;
+
+    get_faults(&minflt, &majflt);
+
+    /* Reset the heap and initialize the allocator */
+    if (a->init() < 0) 
+	app_error("init failed in eval_trace_speed");
+    if (touch)
+	memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+
+    /* Interpret each trace request */
+    for (i = 0;  i < trace->num_ops;  i++) {
+	if (touch)
+	    touch_op(trace, i, 1);
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = a->malloc(size)) == NULL)
+		app_error("malloc error in eval_trace_speed");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* realloc */
+	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_malloc(newsize)) == NULL)
-		app_error("mm_realloc error in eval_mm_speed");
-            mm_free(oldp);
+            if ((newp = a->realloc(oldp, newsize)) == NULL)
+		app_error("realloc error in eval_trace_speed");
             trace->blocks[index] = newp;
             break;
 
-        case FREE: /* mm_free */
+        case FREE: /* free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            a->free(block);
             break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in eval_trace_speed");
         }
+	if (touch)
+	    touch_op(trace, i, 0);
+    }
 
-    mem_reset();
+    params->minflt -= minflt;
+    params->majflt -= majflt;
+    get_faults(&minflt, &majflt);
+    params->minflt += minflt;
+    params->majflt += majflt;
+    params->runs++;
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * eval_latency - Replay the trace once more on the allocator a, timing
+ *    each request on its own. This is kept out of eval_trace_speed
+ *    because reading the clock around every request would distort the
+ *    throughput.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static void eval_latency(allocator_t *a, trace_t *trace, latency_t *lat)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
+    int i, index, size;
+    char *p;
+    uint64_t start, end;
+
+    lat_init(lat);
+    if (a->init() < 0) 
+	app_error("init failed in eval_latency");
 
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
 
+        switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = p;
-	    break;
+	    start = lat_now();
+            p = a->malloc(size);
+	    end = lat_now();
+            if (p == NULL)
+		app_error("malloc error in eval_latency");
+	    lat_record(lat, ALLOC, size, start, end);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
 
 	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
-	    if ((newp = realloc(oldp, newsize)) == NULL) {
-		malloc_error(tracenum, i, "libc realloc failed");
-		unix_error("System message");
+	    start = lat_now();
+            p = a->realloc(trace->blocks[index], size);
+	    end = lat_now();
+            if (p == NULL)
+		app_error("realloc error in eval_latency");
+	    lat_record(lat, REALLOC, size, start, end);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case FREE: /* free, banded by the size of the block freed */
+	    start = lat_now();
+            a->free(trace->blocks[index]);
+	    end = lat_now();
+	    lat_record(lat, FREE, trace->block_sizes[index], start, end);
+            break;
+        }
+    }
+}
+
+/*********************************************************************
+ * The following routines replay stream traces. These are read in
+ * chunks by tstream.c and the live blocks are kept in a hash table
+ * keyed by id, so neither the requests nor the ids need to fit in
+ * memory. Correctness and utilization are checked in one pass.
+ *********************************************************************/
+
+/*
+ * idmap_hash - Return the home slot of index
+ */
+static size_t idmap_hash(idmap_t *ids, uint64_t index)
+{
+    return (index * 0x9e3779b97f4a7c15ULL) >> (64 - ids->bits);
+}
+
+/*
+ * idmap_clear - Forget all the live blocks
+ */
+static void idmap_clear(idmap_t *ids)
+{
+    if (ids->slots == NULL || ids->bits != IDMAP_INIT_BITS) {
+	free(ids->slots);
+	ids->bits = IDMAP_INIT_BITS;
+	if ((ids->slots = calloc((size_t)1 << ids->bits, sizeof(idslot_t))) == NULL)
+	    unix_error("calloc failed in idmap_clear");
+    }
+    else
+	memset(ids->slots, 0, ((size_t)1 << ids->bits) * sizeof(idslot_t));
+    ids->count = 0;
+}
+
+/*
+ * idmap_get - Return the slot of the live block with id index, or NULL
+ */
+static idslot_t *idmap_get(idmap_t *ids, uint64_t index)
+{
+    size_t mask = ((size_t)1 << ids->bits) - 1;
+    size_t i;
+
+    for (i = idmap_hash(ids, index); ids->slots[i].block; i = (i + 1) & mask)
+	if (ids->slots[i].index == index)
+	    return &ids->slots[i];
+    return NULL;
+}
+
+/*
+ * idmap_put - Return an empty slot for the new block with id index.
+ *     The caller must fill in its block before the next idmap call.
+ */
+static idslot_t *idmap_put(idmap_t *ids, uint64_t index)
+{
+    size_t mask, i, n;
+    idslot_t *old;
+
+    /* Keep the table at most half full */
+    if (2 * (ids->count + 1) > ((size_t)1 << ids->bits)) {
+	old = ids->slots;
+	n = (size_t)1 << ids->bits;
+	ids->bits++;
+	if ((ids->slots = calloc((size_t)1 << ids->bits, sizeof(idslot_t))) == NULL)
+	    unix_error("calloc failed in idmap_put");
+	mask = ((size_t)1 << ids->bits) - 1;
+	for (i = 0; i < n; i++) {
+	    if (old[i].block) {
+		size_t j = idmap_hash(ids, old[i].index);
+		while (ids->slots[j].block)
+		    j = (j + 1) & mask;
+		ids->slots[j] = old[i];
 	    }
-	    trace->blocks[trace->ops[i].index] = newp;
-	    break;
-	    
-        case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
-	    break;
+	}
+	free(old);
+    }
 
-	default:
-	    app_error("invalid operation type  in eval_libc_valid");
+    mask = ((size_t)1 << ids->bits) - 1;
+    for (i = idmap_hash(ids, index); ids->slots[i].block; i = (i + 1) & mask)
+	;
+    ids->count++;
+    ids->slots[i].index = index;
+    return &ids->slots[i];
+}
+
+/*
+ * idmap_remove - Empty slot, shifting back any later blocks of its
+ *     probe run so that lookups never stop early
+ */
+static void idmap_remove(idmap_t *ids, idslot_t *slot)
+{
+    size_t mask = ((size_t)1 << ids->bits) - 1;
+    size_t hole = slot - ids->slots;
+    size_t i, home;
+
+    for (i = (hole + 1) & mask; ids->slots[i].block; i = (i + 1) & mask) {
+	home = idmap_hash(ids, ids->slots[i].index);
+	/* move i into the hole unless its home lies in (hole, i] */
+	if (((i - home) & mask) >= ((i - hole) & mask)) {
+	    ids->slots[hole] = ids->slots[i];
+	    hole = i;
 	}
     }
+    ids->slots[hole].block = NULL;
+    ids->count--;
+}
 
-    return 1;
+/*
+ * eval_stream - Check the allocator a for correctness on the stream
+ *     trace at path, and measure its space utilization in the same
+ *     pass if it can be. Fills in stats and returns whether the trace
+ *     was processed correctly.
+ */
+static int eval_stream(allocator_t *a, char *path, int tracenum,
+		       ranges_t *ranges, stats_t *stats)
+{
+    tstream_t *s;
+    tstream_op_t *ops;
+    idslot_t *slot;
+    idmap_t ids;
+    uint64_t opnum = 0;
+    int i, n, size;
+    char *p;
+    size_t max_total_size = 0, max_heap_size = 0;
+    size_t heap_size = 0, total_size = 0;
+    double ratio, ratio_frac, accum_ratio_frac = 1.0, accum_ratio_exp = 0.0;
+    int ratio_exp, valid = 0;
+    uint64_t start;
+    alloc_stats_t st;
+    timeline_t tl;
+    int timeline = timeline_path && a == allocs[0] && a->stats;
+
+    memset(&st, 0, sizeof(st));
+    if (timeline)
+	tl_init(&tl, TL_POINTS);
+    memset(&ids, 0, sizeof(ids));
+    idmap_clear(&ids);
+    clear_ranges(ranges);
+    s = tstream_open(path);
+    stats->ops = tstream_header(s)->num_ops;
+    memset(&stats->re, 0, sizeof(stats->re));
+
+    if (a->init() < 0) {
+	malloc_error(tracenum, 0, "init failed.");
+	goto out;
+    }
+
+    while ((n = tstream_next(s, &ops)) > 0) {
+	for (i = 0; i < n; i++, opnum++) {
+	    size = ops[i].size;
+	    slot = idmap_get(&ids, ops[i].index);
+
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* malloc */
+		if (slot != NULL)
+		    app_error("Stream trace allocates a live id");
+		if ((p = a->malloc(size)) == NULL) {
+		    malloc_error(tracenum, opnum, "malloc failed.");
+		    goto out;
+		}
+		if (add_range(ranges, p, size, tracenum, opnum) == 0)
+		    goto out;
+		if (!check_usable(a, p, size)) {
+		    malloc_error(tracenum, opnum, "usable size is less than the request.");
+		    goto out;
+		}
+		memset(p, ops[i].index & 0xFF, size);
+		slot = idmap_put(&ids, ops[i].index);
+		slot->block = p;
+		slot->size = size;
+		total_size += size;
+		break;
+
+	    case REALLOC: /* realloc */
+		if (slot == NULL)
+		    app_error("Stream trace reallocs an id that is not live");
+		start = lat_now();
+		if ((p = a->realloc(slot->block, size)) == NULL) {
+		    malloc_error(tracenum, opnum, "realloc failed.");
+		    goto out;
+		}
+		if (!check_realloc(slot->block, slot->size, p, size,
+				   ops[i].index & 0xFF, start, &stats->re)) {
+		    malloc_error(tracenum, opnum, "realloc lost the old contents.");
+		    goto out;
+		}
+		remove_range(ranges, slot->block);
+		if (add_range(ranges, p, size, tracenum, opnum) == 0)
+		    goto out;
+		if (!check_usable(a, p, size)) {
+		    malloc_error(tracenum, opnum, "usable size is less than the request.");
+		    goto out;
+		}
+		memset(p, ops[i].index & 0xFF, size);
+		total_size += size - slot->size;
+		slot->block = p;
+		slot->size = size;
+		break;
+
+	    case FREE: /* free */
+		if (slot == NULL)
+		    app_error("Stream trace frees an id that is not live");
+		remove_range(ranges, slot->block);
+		a->free(slot->block);
+		total_size -= slot->size;
+		idmap_remove(&ids, slot);
+		break;
+	    }
+
+	    /* Update statistics, as in eval_util */
+	    if (a->stats == NULL)
+		continue;
+	    max_total_size = ((total_size > max_total_size) ?
+			      total_size
+			      : max_total_size);
+
+	    a->stats(&st);
+	    heap_size = st.heap;
+	    if (heap_size > max_heap_size)
+		max_heap_size = heap_size;
+
+	    ratio = (double)(total_size + 1) / (heap_size + 1);
+
+	    ratio_frac = frexp(ratio, &ratio_exp);
+
+	    accum_ratio_frac *= ratio_frac;
+	    accum_ratio_exp += ratio_exp;
+
+	    accum_ratio_frac = frexp(accum_ratio_frac, &ratio_exp);
+	    accum_ratio_exp += ratio_exp;
+
+	    if (timeline)
+		tl_add(&tl, opnum, total_size, heap_size, st.mappings);
+	}
+    }
+
+    if (a->stats) {
+	stats->util = (double)max_total_size / max_heap_size;
+	stats->inst_util = accum_ratio_frac * pow(2, accum_ratio_exp / opnum);
+    }
+    valid = 1;
+    if (timeline)
+	tl_write(&tl, timeline_path, tracenum);
+
+ out:
+    if (a->stats) {
+	a->stats(&st);
+	stats->mem = st.mem;
+    }
+    tstream_close(s);
+    free(ids.slots);
+    if (timeline)
+	tl_free(&tl);
+    return valid;
 }
 
-/* 
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+/*
+ * eval_stream_speed - This is the function that is used by
+ *    eval_speed to measure the running time of the allocator in params
+ *    on a stream trace.
  */
-static void eval_libc_speed(void *ptr)
+static void eval_stream_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    speed_t *params = (speed_t *)ptr;
+    allocator_t *a = params->alloc;
+    tstream_t *s;
+    tstream_op_t *ops;
+    idslot_t *slot;
+    int i, n;
+    char *p;
+    long minflt, majflt;
+
+    idmap_clear(params->ids);
+    s = tstream_open(params->stream);
+    params->ops = 0;
+
+    get_faults(&minflt, &majflt);
+    params->minflt -= minflt;
+    params->majflt -= majflt;
+
+    if (a->init() < 0) 
+	app_error("init failed in eval_stream_speed");
+
+    while ((n = tstream_next(s, &ops)) > 0) {
+	for (i = 0; i < n; i++) {
+	    switch (ops[i].type) {
+	    case ALLOC: /* malloc */
+		if ((p = a->malloc(ops[i].size)) == NULL)
+		    app_error("malloc error in eval_stream_speed");
+		slot = idmap_put(params->ids, ops[i].index);
+		slot->block = p;
+		slot->size = ops[i].size;
+		if (touch)
+		    touch_write(p, ops[i].size);
+		break;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-        case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
-		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
-	    break;
+	    case REALLOC: /* realloc */
+		slot = idmap_get(params->ids, ops[i].index);
+		if ((p = a->realloc(slot->block, ops[i].size)) == NULL)
+		    app_error("realloc error in eval_stream_speed");
+		slot->block = p;
+		slot->size = ops[i].size;
+		if (touch)
+		    touch_write(p, ops[i].size);
+		break;
 
-	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-	    if ((newp = malloc(newsize)) == NULL)
-		unix_error("malloc failed in eval_libc_speed\n");
-            free(oldp);
-	    
-	    trace->blocks[index] = newp;
-	    break;
-	    
-        case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
-	    free(block);
-	    break;
+	    case FREE: /* free */
+		slot = idmap_get(params->ids, ops[i].index);
+		if (touch)
+		    touch_read(slot->block, slot->size);
+		a->free(slot->block);
+		idmap_remove(params->ids, slot);
+		break;
+	    }
 	}
+	params->ops += n;
+    }
+
+    get_faults(&minflt, &majflt);
+    params->minflt += minflt;
+    params->majflt += majflt;
+    params->runs++;
+
+    tstream_close(s);
+}
+
+/*
+ * eval_stream_latency - Replay the stream trace at path once more on
+ *    the allocator a, timing each request on its own, as eval_latency
+ *    does
+ */
+static void eval_stream_latency(allocator_t *a, char *path, idmap_t *ids,
+				latency_t *lat)
+{
+    tstream_t *s;
+    tstream_op_t *ops;
+    idslot_t *slot;
+    int i, n;
+    char *p;
+    uint64_t start, end;
+
+    lat_init(lat);
+    idmap_clear(ids);
+    s = tstream_open(path);
+    if (a->init() < 0) 
+	app_error("init failed in eval_stream_latency");
+
+    while ((n = tstream_next(s, &ops)) > 0) {
+	for (i = 0; i < n; i++) {
+	    switch (ops[i].type) {
+	    case ALLOC: /* malloc */
+		start = lat_now();
+		p = a->malloc(ops[i].size);
+		end = lat_now();
+		if (p == NULL)
+		    app_error("malloc error in eval_stream_latency");
+		lat_record(lat, ALLOC, ops[i].size, start, end);
+		slot = idmap_put(ids, ops[i].index);
+		slot->block = p;
+		slot->size = ops[i].size;
+		break;
+
+	    case REALLOC: /* realloc */
+		slot = idmap_get(ids, ops[i].index);
+		start = lat_now();
+		p = a->realloc(slot->block, ops[i].size);
+		end = lat_now();
+		if (p == NULL)
+		    app_error("realloc error in eval_stream_latency");
+		lat_record(lat, REALLOC, ops[i].size, start, end);
+		slot->block = p;
+		slot->size = ops[i].size;
+		break;
+
+	    case FREE: /* free */
+		slot = idmap_get(ids, ops[i].index);
+		start = lat_now();
+		a->free(slot->block);
+		end = lat_now();
+		lat_record(lat, FREE, slot->size, start, end);
+		idmap_remove(ids, slot);
+		break;
+	    }
+	}
+    }
+
+    tstream_close(s);
+}
+
+/*
+ * eval_speed - Time the speed function f on the trace in params with
+ *    the selected timing package, and record the average number of
+ *    page faults that each timed run took in stats.
+ */
+static double eval_speed(void (*f)(void *), speed_t *params, stats_t *stats)
+{
+    double secs;
+
+    params->runs = 0;
+    params->minflt = 0;
+    params->majflt = 0;
+
+    if (timing_lock)
+	pthread_mutex_lock(timing_lock);
+
+    /* A stream trace may take hours to replay, so it is timed only once */
+    if (params->stream)
+	secs = fsecs_once(f, params);
+    else
+	secs = fsecs(f, params);
+    stats->nsamples = fsecs_samples(stats->samples);
+    stats->cv = fsecs_cv();
+
+    if (timing_lock)
+	pthread_mutex_unlock(timing_lock);
+    if (params->runs > 0) {
+	stats->minflt = (double)params->minflt / params->runs;
+	stats->majflt = (double)params->majflt / params->runs;
+    }
+    return secs;
+}
+
+/*
+ * eval_perf - Count the hardware events of one more run of the speed
+ *     function f. It is kept apart from the timed runs, which also run
+ *     fcyc's cache-clearing code.
+ */
+static void eval_perf(void (*f)(void *), speed_t *params, stats_t *stats)
+{
+    if (timing_lock)
+	pthread_mutex_lock(timing_lock);
+    perf_start();
+    f(params);
+    perf_stop(&stats->perf);
+    if (timing_lock)
+	pthread_mutex_unlock(timing_lock);
+}
+
+/*
+ * eval_threads - Time the trace replayed by 1, 2, 4, ... threads up
+ *     to the -M maximum, or up to the trace's own number of threads if
+ *     it has several. Each thread's rate comes from the last timed run.
+ */
+static void eval_threads(trace_t *trace, allocator_t *a, stats_t *stats)
+{
+    replay_t *r;
+    mt_stats_t *mt;
+    int n, k, max = mt_threads;
+    double ops, secs;
+
+    if (trace->num_threads > 1 && max > trace->num_threads)
+	max = trace->num_threads;
+    stats->nmt = 0;
+    for (n = 1; stats->nmt < MT_MAX_STEPS; n = (2*n < max) ? 2*n : max) {
+	mt = &stats->mt[stats->nmt++];
+	r = replay_prepare(trace, n, a);
+
+	if (timing_lock)
+	    pthread_mutex_lock(timing_lock);
+	fsecs(replay_run, r);  /* for its runs; the time is replay_secs */
+	mt->secs = replay_secs(r);
+	if (timing_lock)
+	    pthread_mutex_unlock(timing_lock);
+
+	mt->threads = n;
+	mt->ops = replay_ops(r);
+	for (k = 0; k < n; k++) {
+	    replay_thread_result(r, k, &ops, &secs);
+	    mt->thread_kops[k] = secs > 0 ? (ops/1e3)/secs : 0;
+	}
+	replay_free(r);
+	if (n == max)
+	    break;
     }
 }
 
+/*
+ * get_faults - Return the minor and major page fault counts of this
+ *    process so far
+ */
+static void get_faults(long *minflt, long *majflt)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+	unix_error("getrusage failed");
+    *minflt = usage.ru_minflt;
+    *majflt = usage.ru_majflt;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -930,58 +2128,822 @@ static void printresults(int n, stats_t *stats)
     double ops = 0;
     double util = 0;
     double inst_util = 0;
+    double minflt = 0;
+    double majflt = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%7s%7s%10s%6s\n", 
-	   "trace", " valid", "util", "util_i", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%7s%7s%10s%6s%8s%7s%6s\n", 
+	   "trace", " valid", "util", "util_i", "ops", "secs", "Kops",
+	   "minflt", "majflt", "cv%");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f%8.0f%7.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].inst_util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   stats[i].minflt,
+		   stats[i].majflt);
+	    if (stats[i].cv >= 0)
+		printf("%6.1f\n", stats[i].cv*100.0);
+	    else
+		printf("%6s\n", "-");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
 	    inst_util += stats[i].inst_util;
+	    minflt += stats[i].minflt;
+	    majflt += stats[i].majflt;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%6s%8s%7s\n", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
+		   "-",
+		   "-",
 		   "-");
 	}
     }
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f%8.0f%7.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       (inst_util/n)*100.0,
 	       ops, 
 	       secs,
-	       (ops/1e3)/secs);
+	       (ops/1e3)/secs,
+	       minflt,
+	       majflt);
     }
     else {
-	printf("%12s%6s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%6s%8s%10s%6s%8s%7s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
 	       "-", 
+	       "-",
+	       "-",
 	       "-");
     }
 
 }
 
+/*
+ * printalloc - prints the tables asked for about one allocator
+ */
+static void printalloc(int n, allocator_t *a, stats_t *stats)
+{
+    if (verbose) {
+	printf("\nResults for %s:\n", a->desc);
+	printresults(n, stats);
+	if (a->stats) {
+	    printf("\nKernel activity for %s (util run):\n", a->desc);
+	    printmemstats(n, stats);
+	}
+	printf("\nReallocs of %s (correctness run):\n", a->desc);
+	printrealloc(n, stats);
+	printf("\n");
+    }
+    if (output != OUT_TEXT)
+	return;
+    if (latency) {
+	printf("\nRequest latency for %s:\n", a->desc);
+	printlatency(n, stats);
+	printf("\n");
+    }
+    if (perfctr) {
+	printf("\nHardware events per request for %s:\n", a->desc);
+	printperf(n, stats);
+	printf("\n");
+    }
+    if (mt_threads) {
+	printf("\nMultithreaded replay for %s%s:\n", a->desc,
+	       a->thread_safe ? "" : " (calls serialized by a lock)");
+	printthreads(n, stats);
+	printf("\n");
+    }
+}
+
+/*
+ * printcompare_cell - prints one allocator's Kops and utilization
+ */
+static void printcompare_cell(allocator_t *a, stats_t *st)
+{
+    if (!st->valid)
+	printf("%16s", "-");
+    else if (a->stats)
+	printf("%10.0f%5.0f%%", (st->ops/1e3)/st->secs, st->util*100.0);
+    else
+	printf("%10.0f%6s", (st->ops/1e3)/st->secs, "-");
+}
+
+/*
+ * printcompare - prints the throughput and utilization of every
+ *     allocator side by side, one row per trace
+ */
+static void printcompare(int n, stats_t **stats)
+{
+    int i, k;
+    stats_t *total;
+
+    printf("%5s", "trace");
+    for (k = 0; k < nallocs; k++)
+	printf("%16s", allocs[k]->name);
+    printf("\n");
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	for (k = 0; k < nallocs; k++)
+	    printcompare_cell(allocs[k], &stats[k][i]);
+	printf("\n");
+    }
+
+    if ((total = malloc(sizeof(stats_t))) == NULL)
+	unix_error("malloc failed in printcompare");
+    printf("%-5s", "Total");
+    for (k = 0; k < nallocs; k++) {
+	sum_stats(n, stats[k], total);
+	printcompare_cell(allocs[k], total);
+    }
+    printf("\n");
+    free(total);
+}
+
+/*
+ * printmemstats - prints how often the mm package asked memlib to
+ *     change its mappings, and the time spent in those system calls
+ */
+static void printmemstats(int n, stats_t *stats)
+{
+    int i;
+    mem_stats_t *m;
+
+    printf("%5s%8s%8s%8s%8s%10s%10s%6s%9s\n",
+	   "trace", "maps", "unmaps", "remaps", "commits",
+	   "MBmapped", "MBunmap", "peak", "sys ms");
+    for (i=0; i < n; i++) {
+	m = &stats[i].mem;
+	if (stats[i].valid) {
+	    printf("%2d%11ld%8ld%8ld%8ld%10.1f%10.1f%6ld%9.3f\n",
+		   i,
+		   m->map_calls,
+		   m->unmap_calls,
+		   m->remap_calls,
+		   m->commit_calls,
+		   m->bytes_mapped/1048576.0,
+		   m->bytes_unmapped/1048576.0,
+		   m->peak_mappings,
+		   m->syscall_secs*1e3);
+	}
+	else {
+	    printf("%2d%11s%8s%8s%8s%10s%10s%6s%9s\n",
+		   i, "-", "-", "-", "-", "-", "-", "-", "-");
+	}
+    }
+}
+
+/*
+ * printrealloc - prints how many of each trace's reallocs kept their
+ *     block in place, how much the others copied, and the time spent
+ *     in realloc
+ */
+static void printrealloc(int n, stats_t *stats)
+{
+    int i;
+    realloc_stats_t *re;
+
+    printf("%5s%10s%10s%10s%10s%10s\n",
+	   "trace", "reallocs", "inplace%", "MBcopied", "secs", "usecs/op");
+    for (i=0; i < n; i++) {
+	re = &stats[i].re;
+	if (stats[i].valid && re->count > 0)
+	    printf("%2d%13.0f%10.1f%10.1f%10.6f%10.3f\n",
+		   i,
+		   re->count,
+		   100.0*re->inplace/re->count,
+		   re->copied/1048576.0,
+		   re->secs,
+		   re->secs*1e6/re->count);
+	else
+	    printf("%2d%13s%10s%10s%10s%10s\n",
+		   i, stats[i].valid ? "0" : "-", "-", "-", "-", "-");
+    }
+}
+
+/*
+ * printlatency - prints the latency percentiles of each trace
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i;
+
+    for (i=0; i < n; i++) {
+	printf("trace %d:\n", i);
+	if (stats[i].valid)
+	    lat_print(&stats[i].lat);
+	else
+	    printf("-\n");
+    }
+}
+
+/*
+ * printperf - prints the hardware events of each trace per request
+ */
+static void printperf(int n, stats_t *stats)
+{
+    int i, e;
+    perf_counts_t *p;
+
+    printf("%5s%8s%8s%6s%8s%8s%8s%8s\n", "trace", "instr", "cycles",
+	   "IPC", "L1d", "LLC", "dTLB", "branch");
+    for (i=0; i < n; i++) {
+	p = &stats[i].perf;
+	if (!stats[i].valid) {
+	    printf("%2d%11s\n", i, "-");
+	    continue;
+	}
+	printf("%2d", i);
+	for (e = 0; e < PERF_NEVENTS; e++) {
+	    if (e == PERF_L1D_MISSES) {
+		if (p->valid[PERF_INSTRUCTIONS] && p->valid[PERF_CYCLES]
+		    && p->count[PERF_CYCLES] > 0)
+		    printf("%6.2f", p->count[PERF_INSTRUCTIONS]
+			   / p->count[PERF_CYCLES]);
+		else
+		    printf("%6s", "-");
+	    }
+	    if (p->valid[e])
+		printf("%*.*f", e == 0 ? 11 : 8, e < PERF_L1D_MISSES ? 0 : 3,
+		       p->count[e] / stats[i].ops);
+	    else
+		printf("%*s", e == 0 ? 11 : 8, "-");
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printthreads - prints the aggregate and per-thread throughput of
+ *     each trace's multithreaded replays
+ */
+static void printthreads(int n, stats_t *stats)
+{
+    int i, j, k;
+    mt_stats_t *mt;
+    double lo, hi, sum;
+
+    printf("%5s%8s%10s%10s%24s\n", "trace", "threads", "secs", "Kops",
+	   "thread Kops min/avg/max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].nmt == 0) {
+	    printf("%2d%11s\n", i, "-");
+	    continue;
+	}
+	for (j = 0; j < stats[i].nmt; j++) {
+	    mt = &stats[i].mt[j];
+	    lo = hi = sum = mt->thread_kops[0];
+	    for (k = 1; k < mt->threads; k++) {
+		lo = (mt->thread_kops[k] < lo) ? mt->thread_kops[k] : lo;
+		hi = (mt->thread_kops[k] > hi) ? mt->thread_kops[k] : hi;
+		sum += mt->thread_kops[k];
+	    }
+	    printf("%2d%11d%10.6f%10.0f%10.0f/%6.0f/%6.0f\n", i, mt->threads,
+		   mt->secs, (mt->ops/1e3)/mt->secs, lo, sum/mt->threads, hi);
+	}
+    }
+}
+
+/*
+ * printjson_string - prints str as a JSON string
+ */
+static void printjson_string(char *str)
+{
+    putchar('"');
+    for (; *str; str++) {
+	if (*str == '"' || *str == '\\')
+	    printf("\\%c", *str);
+	else if ((unsigned char)*str < 0x20)
+	    printf("\\u%04x", *str);
+	else
+	    putchar(*str);
+    }
+    putchar('"');
+}
+
+/*
+ * printjson_hist - prints the percentiles of one latency histogram
+ */
+static void printjson_hist(lat_hist_t *h)
+{
+    printf("{\"count\": %lu, \"p50_ns\": %lu, \"p90_ns\": %lu, "
+	   "\"p99_ns\": %lu, \"p99.9_ns\": %lu, \"max_ns\": %lu}",
+	   (unsigned long)h->count,
+	   (unsigned long)lat_percentile(h, 0.5),
+	   (unsigned long)lat_percentile(h, 0.9),
+	   (unsigned long)lat_percentile(h, 0.99),
+	   (unsigned long)lat_percentile(h, 0.999),
+	   (unsigned long)h->max);
+}
+
+/*
+ * printjson_latency - prints the latency histograms of one trace, by
+ *     request type and then by size band
+ */
+static void printjson_latency(latency_t *lat)
+{
+    lat_hist_t all;
+    int t, b;
+
+    printf("{\"clock_overhead_ns\": %lu", (unsigned long)lat->overhead);
+    for (t = 0; t < LAT_TYPES; t++) {
+	memset(&all, 0, sizeof(all));
+	printf(", \"%s\": {\"bands\": {", lat_type_names[t]);
+	for (b = 0; b < LAT_BANDS; b++) {
+	    printf("%s\"%s\": ", b ? ", " : "", lat_band_names[b]);
+	    printjson_hist(&lat->hist[t][b]);
+	    lat_merge(&all, &lat->hist[t][b]);
+	}
+	printf("}, \"all\": ");
+	printjson_hist(&all);
+	printf("}");
+    }
+    printf("}");
+}
+
+/*
+ * printjson_stats - prints the stats of one allocator on every trace
+ *     and over all of them, as printresults does
+ */
+static void printjson_stats(int n, char **tracefiles, stats_t *stats,
+			    allocator_t *a)
+{
+    int i, j, k;
+    stats_t *total;
+    mem_stats_t *m;
+    mt_stats_t *mt;
+
+    printf("{\n    \"traces\": [");
+    for (i=0; i < n; i++) {
+	printf("%s\n      {\"trace\": %d, \"name\": ", i ? "," : "", i);
+	printjson_string(tracefiles[i]);
+	printf(", \"valid\": %s, \"ops\": %.0f",
+	       stats[i].valid ? "true" : "false", stats[i].ops);
+	if (!stats[i].valid) {
+	    printf("}");
+	    continue;
+	}
+	printf(", \"secs\": %.9f, \"kops\": %.3f, \"minflt\": %.1f, "
+	       "\"majflt\": %.1f, \"samples\": [",
+	       stats[i].secs, (stats[i].ops/1e3)/stats[i].secs,
+	       stats[i].minflt, stats[i].majflt);
+	for (j = 0; j < stats[i].nsamples; j++)
+	    printf("%s%.9f", j ? ", " : "", stats[i].samples[j]);
+	printf("]");
+	if (stats[i].cv >= 0)
+	    printf(", \"cv\": %.6f", stats[i].cv);
+	else
+	    printf(", \"cv\": null");
+	if (stats[i].nmt > 0) {
+	    printf(",\n       \"threads\": [");
+	    for (j = 0; j < stats[i].nmt; j++) {
+		mt = &stats[i].mt[j];
+		printf("%s{\"threads\": %d, \"ops\": %.0f, \"secs\": %.9f, "
+		       "\"kops\": %.3f, \"thread_kops\": [", j ? ", " : "",
+		       mt->threads, mt->ops, mt->secs, (mt->ops/1e3)/mt->secs);
+		for (k = 0; k < mt->threads; k++)
+		    printf("%s%.3f", k ? ", " : "", mt->thread_kops[k]);
+		printf("]}");
+	    }
+	    printf("]");
+	}
+	if (a->stats) {
+	    m = &stats[i].mem;
+	    printf(", \"util\": %.6f, \"inst_util\": %.6f",
+		   stats[i].util, stats[i].inst_util);
+	    printf(",\n       \"mem\": {\"map_calls\": %ld, "
+		   "\"unmap_calls\": %ld, \"remap_calls\": %ld, "
+		   "\"commit_calls\": %ld, \"bytes_mapped\": %lu, "
+		   "\"bytes_unmapped\": %lu, \"peak_mappings\": %ld, "
+		   "\"syscall_secs\": %.9f}",
+		   m->map_calls, m->unmap_calls, m->remap_calls,
+		   m->commit_calls, (unsigned long)m->bytes_mapped,
+		   (unsigned long)m->bytes_unmapped, m->peak_mappings,
+		   m->syscall_secs);
+	}
+	printf(",\n       \"realloc\": {\"count\": %.0f, \"inplace\": %.0f, "
+	       "\"bytes_copied\": %.0f, \"secs\": %.9f}",
+	       stats[i].re.count, stats[i].re.inplace, stats[i].re.copied,
+	       stats[i].re.secs);
+	if (latency) {
+	    printf(",\n       \"latency\": ");
+	    printjson_latency(&stats[i].lat);
+	}
+	if (perfctr) {
+	    printf(",\n       \"perf\": {");
+	    for (j = 0; j < PERF_NEVENTS; j++) {
+		printf("%s\"%s\": ", j ? ", " : "", perf_event_names[j]);
+		if (stats[i].perf.valid[j])
+		    printf("%.0f", stats[i].perf.count[j]);
+		else
+		    printf("null");
+	    }
+	    printf("}");
+	}
+	printf("}");
+    }
+    printf("\n    ],\n    \"total\": ");
+    if ((total = malloc(sizeof(stats_t))) == NULL)
+	unix_error("malloc failed in printjson_stats");
+    sum_stats(n, stats, total);
+    if (total->valid && (errors == 0 || a != allocs[0])) {
+	printf("{\"ops\": %.0f, \"secs\": %.9f, \"kops\": %.3f, "
+	       "\"minflt\": %.1f, \"majflt\": %.1f",
+	       total->ops, total->secs, (total->ops/1e3)/total->secs,
+	       total->minflt, total->majflt);
+	if (a->stats)
+	    printf(", \"util\": %.6f, \"inst_util\": %.6f",
+		   total->util, total->inst_util);
+	printf("}");
+    }
+    else
+	printf("null");
+    free(total);
+    printf("\n  }");
+}
+
+/*
+ * printjson - prints the results, and how they were measured, as one
+ *     JSON document
+ */
+static void printjson(int n, char **tracefiles, stats_t **stats,
+		      int numcorrect, double perfindex, double thru_share,
+		      double util_share)
+{
+    int k;
+    struct utsname host;
+
+    if (uname(&host) < 0)
+	unix_error("uname failed in printjson");
+
+    printf("{\n  \"driver\": {\n    \"timing\": ");
+    printjson_string(fsecs_method());
+    printf(",\n    \"stream_timing\": \"1 run\"");
+    printf(",\n    \"host\": {\"name\": ");
+    printjson_string(host.nodename);
+    printf(", \"os\": ");
+    printjson_string(host.sysname);
+    printf(", \"release\": ");
+    printjson_string(host.release);
+    printf(", \"machine\": ");
+    printjson_string(host.machine);
+    printf("},\n    \"cflags\": ");
+    printjson_string(BUILD_CFLAGS);
+    printf(",\n    \"compiler\": ");
+    printjson_string(__VERSION__);
+    printf(",\n    \"tracedir\": ");
+    printjson_string(tracedir);
+    printf(",\n    \"jobs\": %d, \"serialize\": %s, \"pin\": %s",
+	   jobs, serialize ? "true" : "false", pin ? "true" : "false");
+    printf(",\n    \"cpu\": %d, \"warmup\": %d, \"flush_bytes\": %ld, "
+	   "\"nice\": %d", only_cpu, warmup, fsecs_flush_bytes(), nice_value);
+    printf(",\n    \"touch\": \"%s\"",
+	   touch == TOUCH_ALL ? "all" : touch == TOUCH_LINE ? "line" : "none");
+    printf(",\n    \"libc_thruput_kops\": %.0f, \"util_weight\": %.2f, "
+	   "\"util_i_weight\": %.2f\n  },\n",
+	   AVG_LIBC_THRUPUT/1e3, UTIL_WEIGHT, UTIL_I_WEIGHT);
+
+    for (k = 0; k < nallocs; k++) {
+	printf("%s  \"%s\": ", k ? ",\n" : "", allocs[k]->name);
+	printjson_stats(n, tracefiles, stats[k], allocs[k]);
+    }
+    printf(",\n  \"summary\": {\"correct\": %d, \"errors\": %d, "
+	   "\"perfindex\": %.1f",
+	   numcorrect, errors, perfindex);
+    if (thru_share >= 0)
+	printf(", \"thru_of_bump\": %.6f", thru_share);
+    else
+	printf(", \"thru_of_bump\": null");
+    if (util_share >= 0)
+	printf(", \"util_of_oracle\": %.6f", util_share);
+    else
+	printf(", \"util_of_oracle\": null");
+    printf("}\n}\n");
+}
+
+/*
+ * sum_stats - adds up the stats of the valid traces, as printresults
+ *     does for its total row
+ */
+static void sum_stats(int n, stats_t *stats, stats_t *total)
+{
+    int i, t, b;
+
+    memset(total, 0, sizeof(*total));
+    total->valid = 1;
+    total->cv = -1;
+    for (t = 0; t < PERF_NEVENTS; t++)
+	total->perf.valid[t] = 1;
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    total->valid = 0;
+	    continue;
+	}
+	total->ops += stats[i].ops;
+	total->secs += stats[i].secs;
+	total->util += stats[i].util / n;
+	total->inst_util += stats[i].inst_util / n;
+	total->minflt += stats[i].minflt;
+	total->majflt += stats[i].majflt;
+	total->mem.map_calls += stats[i].mem.map_calls;
+	total->mem.unmap_calls += stats[i].mem.unmap_calls;
+	total->mem.remap_calls += stats[i].mem.remap_calls;
+	total->mem.commit_calls += stats[i].mem.commit_calls;
+	total->mem.bytes_mapped += stats[i].mem.bytes_mapped;
+	total->mem.bytes_unmapped += stats[i].mem.bytes_unmapped;
+	if (stats[i].mem.peak_mappings > total->mem.peak_mappings)
+	    total->mem.peak_mappings = stats[i].mem.peak_mappings;
+	total->mem.syscall_secs += stats[i].mem.syscall_secs;
+	total->re.count += stats[i].re.count;
+	total->re.inplace += stats[i].re.inplace;
+	total->re.copied += stats[i].re.copied;
+	total->re.secs += stats[i].re.secs;
+	for (t = 0; t < LAT_TYPES; t++)
+	    for (b = 0; b < LAT_BANDS; b++)
+		lat_merge(&total->lat.hist[t][b], &stats[i].lat.hist[t][b]);
+	for (t = 0; t < PERF_NEVENTS; t++) {
+	    total->perf.valid[t] &= stats[i].perf.valid[t];
+	    total->perf.count[t] += stats[i].perf.count[t];
+	}
+    }
+}
+
+/*
+ * ref_share - returns mm.c's total throughput (or, if util is set, its
+ *     average utilization) as a fraction of the reference allocator
+ *     called name, and sets *ref to the reference's; -1 if that
+ *     allocator was not evaluated or failed a trace
+ */
+static double ref_share(char *name, int n, stats_t **stats,
+			int *alloc_errors, int util, double *ref)
+{
+    int k;
+    double share = -1;
+    stats_t *mm, *total;
+
+    for (k = 1; k < nallocs; k++)
+	if (strcmp(allocs[k]->name, name) == 0)
+	    break;
+    if (k == nallocs || alloc_errors[k] > 0)
+	return -1;
+
+    if ((mm = malloc(2*sizeof(stats_t))) == NULL)
+	unix_error("malloc failed in ref_share");
+    total = mm + 1;
+    sum_stats(n, stats[0], mm);
+    sum_stats(n, stats[k], total);
+    if (mm->valid && total->valid) {
+	*ref = util ? total->util : total->ops/total->secs;
+	if (*ref > 0)
+	    share = (util ? mm->util : mm->ops/mm->secs) / *ref;
+    }
+    free(mm);
+    return share;
+}
+
+/*
+ * csv_quote - Copy s into out, of n bytes, as a quoted CSV field with
+ *     its quotes doubled, cutting it short if it does not fit
+ */
+static void csv_quote(char *out, size_t n, char *s)
+{
+    size_t i = 0;
+
+    if (n < 3) {
+	if (n > 0)
+	    out[0] = '\0';
+	return;
+    }
+    out[i++] = '"';
+    for (; *s != '\0' && i + 3 < n; s++) {
+	if (*s == '"')
+	    out[i++] = '"';
+	out[i++] = *s;
+    }
+    out[i++] = '"';
+    out[i] = '\0';
+}
+
+/*
+ * printcsv_row - prints one CSV row of stats, leaving the fields that
+ *     were not measured empty
+ */
+static void printcsv_row(allocator_t *a, char *trace, char *name,
+			 stats_t *st, char *perfindex, char *common)
+{
+    lat_hist_t all;
+    mem_stats_t *m = &st->mem;
+    int i, t, b;
+
+    char field[2*MAXLINE];
+
+    csv_quote(field, sizeof(field), name);
+    printf("%s,%s,%s,%d,%.0f", a->name, trace, field, st->valid, st->ops);
+    if (st->valid)
+	printf(",%.9f,%.3f,%.1f,%.1f", st->secs, (st->ops/1e3)/st->secs,
+	       st->minflt, st->majflt);
+    else
+	printf(",,,,");
+    if (st->valid && a->stats)
+	printf(",%.6f,%.6f,%ld,%ld,%ld,%ld,%lu,%lu,%ld,%.9f",
+	       st->util, st->inst_util,
+	       m->map_calls, m->unmap_calls, m->remap_calls,
+	       m->commit_calls, (unsigned long)m->bytes_mapped,
+	       (unsigned long)m->bytes_unmapped, m->peak_mappings,
+	       m->syscall_secs);
+    else
+	printf(",,,,,,,,,,");
+    if (st->valid)
+	printf(",%.0f,%.0f,%.0f,%.9f", st->re.count, st->re.inplace,
+	       st->re.copied, st->re.secs);
+    else
+	printf(",,,,");
+    printf(",\"");
+    for (i = 0; st->valid && i < st->nsamples; i++)
+	printf("%s%.9f", i ? " " : "", st->samples[i]);
+    printf("\"");
+    if (st->valid && st->cv >= 0)
+	printf(",%.6f", st->cv);
+    else
+	printf(",");
+    for (t = 0; t < LAT_TYPES; t++) {
+	if (st->valid && latency) {
+	    memset(&all, 0, sizeof(all));
+	    for (b = 0; b < LAT_BANDS; b++)
+		lat_merge(&all, &st->lat.hist[t][b]);
+	    printf(",%lu,%lu,%lu,%lu,%lu,%lu",
+		   (unsigned long)all.count,
+		   (unsigned long)lat_percentile(&all, 0.5),
+		   (unsigned long)lat_percentile(&all, 0.9),
+		   (unsigned long)lat_percentile(&all, 0.99),
+		   (unsigned long)lat_percentile(&all, 0.999),
+		   (unsigned long)all.max);
+	}
+	else
+	    printf(",,,,,,");
+    }
+    for (t = 0; t < PERF_NEVENTS; t++) {
+	if (st->valid && perfctr && st->perf.valid[t])
+	    printf(",%.0f", st->perf.count[t]);
+	else
+	    printf(",");
+    }
+    printf(",%s,%s\n", perfindex, common);
+}
+
+/*
+ * printcsv_stats - prints one CSV row per trace, and a total row, for
+ *     one allocator
+ */
+static void printcsv_stats(int n, char **tracefiles, stats_t *stats,
+			   allocator_t *a, char *perfindex, char *common)
+{
+    stats_t *total;
+    char num[32];
+    int i;
+
+    for (i=0; i < n; i++) {
+	sprintf(num, "%d", i);
+	printcsv_row(a, num, tracefiles[i], &stats[i], "", common);
+    }
+    if ((total = malloc(sizeof(stats_t))) == NULL)
+	unix_error("malloc failed in printcsv_stats");
+    sum_stats(n, stats, total);
+    if (a == allocs[0] && errors)
+	total->valid = 0;
+    printcsv_row(a, "total", "", total, perfindex, common);
+    free(total);
+}
+
+/*
+ * printcsv - prints the results as CSV, one row per allocator and
+ *     trace. Every row repeats how the results were measured, so rows
+ *     from different runs can be loaded into one table.
+ */
+static void printcsv(int n, char **tracefiles, stats_t **stats,
+		     double perfindex)
+{
+    struct utsname host;
+    char common[4*MAXLINE], perf[32], os[2*MAXLINE], *fields[5];
+    size_t len;
+    int t, k;
+
+    if (uname(&host) < 0)
+	unix_error("uname failed in printcsv");
+    snprintf(os, sizeof(os), "%s %s", host.sysname, host.release);
+    fields[0] = fsecs_method();
+    fields[1] = host.nodename;
+    fields[2] = os;
+    fields[3] = host.machine;
+    fields[4] = BUILD_CFLAGS;
+    for (t = 0, len = 0; t < 5; t++) {
+	if (t > 0 && len < sizeof(common) - 1)
+	    common[len++] = ',';
+	csv_quote(common + len, sizeof(common) - len, fields[t]);
+	len += strlen(common + len);
+    }
+
+    printf("allocator,trace,name,valid,ops,secs,kops,minflt,majflt,"
+	   "util,inst_util,map_calls,unmap_calls,remap_calls,commit_calls,"
+	   "bytes_mapped,bytes_unmapped,peak_mappings,syscall_secs,"
+	   "reallocs,realloc_inplace,realloc_bytes_copied,realloc_secs,samples,"
+	   "cv");
+    for (t = 0; t < LAT_TYPES; t++)
+	printf(",%s_count,%s_p50_ns,%s_p90_ns,%s_p99_ns,%s_p99.9_ns,%s_max_ns",
+	       lat_type_names[t], lat_type_names[t], lat_type_names[t],
+	       lat_type_names[t], lat_type_names[t], lat_type_names[t]);
+    for (t = 0; t < PERF_NEVENTS; t++)
+	printf(",%s", perf_event_names[t]);
+    printf(",perfindex,timing,host,os,machine,cflags\n");
+
+    sprintf(perf, "%.1f", perfindex);
+    for (k = 0; k < nallocs; k++)
+	printcsv_stats(n, tracefiles, stats[k], allocs[k], k ? "" : perf,
+		       common);
+}
+
+/*
+ * printbaseline - prints how each trace's throughput and utilization
+ *     changed since the baseline, and returns the number of traces
+ *     that regressed by more than the threshold. A throughput drop
+ *     only counts when it is beyond the 95% confidence interval of the
+ *     two sets of timed runs.
+ */
+static int printbaseline(int n, char **tracefiles, stats_t *stats,
+			 baseline_t *base)
+{
+    base_trace_t *b;
+    double kops[FSECS_MAX_SAMPLES], bkops[FSECS_MAX_SAMPLES];
+    double mean, sd, base_mean, delta, ci, util_delta;
+    int i, slower, worse, regressions = 0;
+
+    if (output == OUT_TEXT) {
+	printf("Comparison with baseline (regression threshold %.1f%%):\n",
+	       threshold);
+	printf("%5s%9s%9s%8s%8s%7s%7s%8s\n", "trace", "baseKops", "Kops",
+	       "delta", "+-95%", "bUtil", "util", "delta");
+    }
+    for (i=0; i < n; i++) {
+	b = base_find(base, tracefiles[i]);
+	if (b == NULL || !b->valid || !stats[i].valid) {
+	    if (output == OUT_TEXT)
+		printf("%2d   %s\n", i, b == NULL ? "not in baseline"
+		       : !b->valid ? "invalid in baseline" : "invalid");
+	    if (b != NULL && b->valid)
+		regressions++;   /* it used to work */
+	    continue;
+	}
+
+	/* Compare the mean throughput of the timed runs */
+	base_kops(stats[i].ops, stats[i].samples, stats[i].nsamples, kops);
+	base_kops(b->ops, b->samples, b->nsamples, bkops);
+	base_mean_sd(kops, stats[i].nsamples, &mean, &sd);
+	base_mean_sd(bkops, b->nsamples, &base_mean, &sd);
+	delta = (mean - base_mean) / base_mean * 100.0;
+	ci = base_diff_ci(bkops, b->nsamples, kops, stats[i].nsamples);
+	if (ci >= 0)
+	    ci = ci / base_mean * 100.0;
+	slower = delta < -threshold && (ci < 0 || delta + ci < 0);
+
+	util_delta = b->util > 0 ?
+	    (stats[i].util - b->util) / b->util * 100.0 : 0;
+	worse = util_delta < -threshold;
+
+	if (output == OUT_TEXT) {
+	    printf("%2d%12.0f%9.0f%+7.1f%%", i, base_mean, mean, delta);
+	    if (ci >= 0)
+		printf("%7.1f%%", ci);
+	    else
+		printf("%8s", "-");
+	    printf("%6.0f%%%6.0f%%%+7.1f%%%s%s\n", b->util*100.0,
+		   stats[i].util*100.0, util_delta,
+		   slower ? "  SLOWER" : "", worse ? "  WORSE UTIL" : "");
+	}
+	if (slower || worse)
+	    regressions++;
+    }
+    if (output == OUT_TEXT)
+	printf("%d of %d traces regressed\n\n", regressions, n);
+    return regressions;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1001,12 +2963,14 @@ void unix_error(char *msg)
 }
 
 /*
- * malloc_error - Report an error returned by the mm_malloc package
+ * malloc_error - Report an error returned by the allocator being
+ *     evaluated
  */
 void malloc_error(int tracenum, int opnum, char *msg)
 {
     errors++;
-    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+    printf("ERROR [%s, trace %d, line %d]: %s\n", evaluated->name, tracenum,
+	   LINENUM(opnum), msg);
 }
 
 /* 
@@ -1014,13 +2978,46 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVlPspLeARB] [-t <dir>] [-c <file>] [-z <file>]\n");
+    fprintf(stderr, "               [-j <jobs>] [-o json|csv] [-F <file>] [-b <file>] [-r <pct>]\n");
+    fprintf(stderr, "               [-T tsc|monotonic|gettod|itimer] [-M <threads>]\n");
+    fprintf(stderr, "               [-x line|all] [-C <cpu>] [-w <runs>] [-K <KB>]\n");
+    fprintf(stderr, "               [-a <list>] [-f <file>]... [-G <spec>]...\n");
     fprintf(stderr, "Options\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-a <list>  Compare mm.c with these allocators, separated by commas:\n");
+    fprintf(stderr, "\t           %s.\n", alloc_names());
+    fprintf(stderr, "\t-A         Profile the traces' sizes, lifetimes and live set instead.\n");
+    fprintf(stderr, "\t-b <file>  Compare with results saved by -o csv in <file>;\n");
+    fprintf(stderr, "\t           exit with status 2 if any trace regressed.\n");
+    fprintf(stderr, "\t-B         Run the bump and oracle allocators as well, and show how\n");
+    fprintf(stderr, "\t           close mm.c comes to their throughput and util bounds.\n");
+    fprintf(stderr, "\t-C <cpu>   Run on CPU <cpu> only (-j workers share it).\n");
+    fprintf(stderr, "\t-c <file>  Convert the -f trace to binary format in <file>.\n");
+    fprintf(stderr, "\t-e         Print hardware events per request.\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as a trace file; may be given with -G.\n");
+    fprintf(stderr, "\t-F <file>  Write each trace's fragmentation timeline to <file>.<n>.csv\n");
+    fprintf(stderr, "\t           (or <file>.<n>.bin in binary if <file> ends in .bin).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-G <spec>  Add a trace generated in memory from <spec>; see gen.h.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
-    fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-j <jobs>  Evaluate traces in <jobs> worker processes.\n");
+    fprintf(stderr, "\t-l         Run libc malloc as well (-a libc).\n");
+    fprintf(stderr, "\t-K <KB>    Flush <KB> of cache before each timed run; 0 for none\n");
+    fprintf(stderr, "\t           (default twice the last level cache).\n");
+    fprintf(stderr, "\t-L         Print per-request latency percentiles.\n");
+    fprintf(stderr, "\t-M <n>     Also replay each trace with 1, 2, 4, ... up to <n> threads.\n");
+    fprintf(stderr, "\t-o <fmt>   Print the results as json or csv instead of text.\n");
+    fprintf(stderr, "\t-p         Pin each -j worker to its own CPU.\n");
+    fprintf(stderr, "\t-P         Pre-fault pages mapped by mem_map.\n");
+    fprintf(stderr, "\t-r <pct>   Regression threshold for -b in percent (default 5).\n");
+    fprintf(stderr, "\t-R         Raise the scheduling priority (needs privileges).\n");
+    fprintf(stderr, "\t-s         Let only one -j worker at a time run timed runs.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <timer> Time with tsc, monotonic, gettod or itimer (K-best).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
+    fprintf(stderr, "\t-w <runs>  Run each speed test <runs> times untimed first.\n");
+    fprintf(stderr, "\t-z <file>  Convert the -f trace to stream format in <file>.\n");
+    fprintf(stderr, "\t-x <mode>  Write new blocks and read live ones in the speed runs:\n");
+    fprintf(stderr, "\t           their first cache line (line) or all of them (all).\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
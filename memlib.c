@@ -1,6 +1,13 @@
 /*
  * memlib.c - bridge to mmap
+ *
+ * mem_map, mem_unmap, mem_remap, mem_reserve, mem_commit and
+ * mem_heapsize may be called from several threads at once; the page counters are atomics and pagemap.c
+ * synchronizes the page map itself. mem_init, mem_reset and
+ * mem_set_prefault must only be called while no other thread is
+ * using the memory system.
  */
+#define _GNU_SOURCE /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -9,14 +16,63 @@
 #include <string.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "memlib.h"
 #include "pagemap.h"
 
 /* private variables */
-static int activity_counter = 0; /* to simulate other processes */
+static atomic_int activity_counter = 0; /* to simulate other processes */
 
-static int page_count;
+static atomic_long page_count;
+
+/* flags for mem_map's mmap; MAP_POPULATE is added when pre-faulting */
+static int map_flags = MAP_PRIVATE | MAP_ANON;
+
+/* address space set aside by mem_reserve, released by mem_reset */
+typedef struct reservation {
+  char *base;
+  size_t size;
+  struct reservation *next;
+} reservation;
+
+static _Atomic(reservation *) reservations;
+
+/* kernel activity, reported by mem_get_stats */
+static atomic_long map_calls, unmap_calls, remap_calls, commit_calls;
+static atomic_long bytes_mapped, bytes_unmapped;
+static atomic_long live_mappings, peak_mappings;
+static atomic_long syscall_nsecs;
+
+static long now_nsecs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* charge a system call that started at start nsecs */
+static void count_syscall(long start)
+{
+  atomic_fetch_add_explicit(&syscall_nsecs, now_nsecs() - start,
+                            memory_order_relaxed);
+}
+
+static void count_mapping(long delta)
+{
+  long live, peak;
+
+  live = atomic_fetch_add_explicit(&live_mappings, delta,
+                                   memory_order_relaxed) + delta;
+  peak = atomic_load_explicit(&peak_mappings, memory_order_relaxed);
+  while (live > peak
+         && !atomic_compare_exchange_weak_explicit(&peak_mappings, &peak, live,
+                                                   memory_order_relaxed,
+                                                   memory_order_relaxed))
+    ;
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -45,9 +101,23 @@ static void unmap(void *p)
  */
 void mem_reset(void)
 {
+  reservation *r, *next;
+
   pagemap_for_each(unmap);
-  page_count = 0;
-  activity_counter = 0;
+
+  /* committed pages are gone now; drop what remains of each reservation */
+  for (r = atomic_exchange(&reservations, NULL); r != NULL; r = next) {
+    next = r->next;
+    if (munmap(r->base, r->size) < 0) {
+      fprintf(stderr, "unexpected error in munmap: %s (%d)\n",
+              strerror(errno), errno);
+      abort();
+    }
+    free(r);
+  }
+  atomic_store(&live_mappings, 0);
+  atomic_store(&page_count, 0);
+  atomic_store(&activity_counter, 0);
 }
 
 /*
@@ -60,7 +130,59 @@ size_t mem_pagesize()
 
 size_t mem_heapsize(void)
 {
-  return APAGE_SIZE * page_count;
+  return APAGE_SIZE * atomic_load_explicit(&page_count, memory_order_relaxed);
+}
+
+/*
+ * mem_mappings - return the number of mappings (heap chunks) now live
+ */
+long mem_mappings(void)
+{
+  return atomic_load_explicit(&live_mappings, memory_order_relaxed);
+}
+
+/*
+ * mem_get_stats - report the kernel activity since mem_reset_stats
+ */
+void mem_get_stats(mem_stats_t *stats)
+{
+  stats->map_calls = atomic_load(&map_calls);
+  stats->unmap_calls = atomic_load(&unmap_calls);
+  stats->remap_calls = atomic_load(&remap_calls);
+  stats->commit_calls = atomic_load(&commit_calls);
+  stats->bytes_mapped = atomic_load(&bytes_mapped);
+  stats->bytes_unmapped = atomic_load(&bytes_unmapped);
+  stats->peak_mappings = atomic_load(&peak_mappings);
+  stats->syscall_secs = atomic_load(&syscall_nsecs) / 1e9;
+}
+
+/*
+ * mem_reset_stats - start counting kernel activity from zero; the
+ *    mappings that are already live still count toward the peak
+ */
+void mem_reset_stats(void)
+{
+  atomic_store(&map_calls, 0);
+  atomic_store(&unmap_calls, 0);
+  atomic_store(&remap_calls, 0);
+  atomic_store(&commit_calls, 0);
+  atomic_store(&bytes_mapped, 0);
+  atomic_store(&bytes_unmapped, 0);
+  atomic_store(&peak_mappings, atomic_load(&live_mappings));
+  atomic_store(&syscall_nsecs, 0);
+}
+
+/*
+ * mem_set_prefault - when nonzero, mem_map and mem_commit ask the
+ *    kernel to populate the page tables up front, so that first-touch
+ *    page faults are not charged to the allocator
+ */
+void mem_set_prefault(int prefault)
+{
+  if (prefault)
+    map_flags |= MAP_POPULATE;
+  else
+    map_flags &= ~MAP_POPULATE;
 }
 
 
@@ -68,6 +190,8 @@ void *mem_map(size_t sz)
 {
   void *p;
   size_t i;
+  int activity;
+  long start;
   
   if (sz & (APAGE_SIZE - 1)) {
     fprintf(stderr, "mem_map: requested size is not a multiple of %d: %ld\n",
@@ -75,24 +199,30 @@ void *mem_map(size_t sz)
     abort();
   }
 
-  activity_counter++;
-  if ((activity_counter & (activity_counter - 1)) == 0) {
+  activity = atomic_fetch_add_explicit(&activity_counter, 1,
+                                       memory_order_relaxed) + 1;
+  if ((activity & (activity - 1)) == 0) {
     /* allocate a page to ensure that mem_map results are not
        always sequential */
     mmap(0, APAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
   }
 
-  p = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  start = now_nsecs();
+  p = mmap(0, sz, PROT_READ | PROT_WRITE, map_flags, -1, 0);
+  count_syscall(start);
   if (p == MAP_FAILED) {
     fprintf(stderr, "mmap failed: %s (%d)\n",
             strerror(errno), errno);
     abort();
   }
+  atomic_fetch_add_explicit(&map_calls, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bytes_mapped, sz, memory_order_relaxed);
+  count_mapping(1);
 
-  for (i = 0; i < sz; i += APAGE_SIZE) {
+  for (i = 0; i < sz; i += APAGE_SIZE)
     pagemap_modify(p + i, 1);
-    page_count++;
-  }
+  atomic_fetch_add_explicit(&page_count, sz / APAGE_SIZE,
+                            memory_order_relaxed);
   
   return p;
 }
@@ -100,6 +230,7 @@ void *mem_map(size_t sz)
 void mem_unmap(void *p, size_t sz)
 {
   size_t i;
+  long start;
   
   if (((uintptr_t)p) & (APAGE_SIZE - 1)) {
     fprintf(stderr, "mem_unmap: given address is not page-aligned: %p\n",
@@ -121,13 +252,173 @@ void mem_unmap(void *p, size_t sz)
     }      
 
     pagemap_modify(p + i, 0);
-    
-    --page_count;
   }
+  atomic_fetch_sub_explicit(&page_count, sz / APAGE_SIZE,
+                            memory_order_relaxed);
 
+  start = now_nsecs();
   if (munmap(p, sz) < 0) {
     fprintf(stderr, "munmap failed: %s (%d)\n",
             strerror(errno), errno);
     abort();
   }
+  count_syscall(start);
+  atomic_fetch_add_explicit(&unmap_calls, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bytes_unmapped, sz, memory_order_relaxed);
+  count_mapping(-1);
+}
+
+/*
+ * mem_remap - resize the mapping of old_size bytes at old to new_size
+ *    bytes, moving it if it cannot grow in place. The kernel moves the
+ *    page tables, so the contents are preserved without being copied.
+ *    Returns the (possibly new) address of the mapping.
+ */
+void *mem_remap(void *old, size_t old_size, size_t new_size)
+{
+  void *p;
+  size_t i;
+  long start;
+
+  if (((uintptr_t)old) & (APAGE_SIZE - 1)) {
+    fprintf(stderr, "mem_remap: given address is not page-aligned: %p\n",
+            old);
+    abort();
+  }
+
+  if ((old_size & (APAGE_SIZE - 1)) || (new_size & (APAGE_SIZE - 1))) {
+    fprintf(stderr, "mem_remap: given sizes are not multiples of %d: %ld, %ld\n",
+            APAGE_SIZE, old_size, new_size);
+    abort();
+  }
+
+  /* Forget the old pages before they can be handed out again by a
+     concurrent mem_map, then record wherever the mapping ended up */
+  for (i = 0; i < old_size; i += APAGE_SIZE) {
+    if (!pagemap_is_mapped(old + i)) {
+      fprintf(stderr, "mem_remap: given page is not mapped: %p (in %p:%p)\n",
+              old + i, old, old + old_size);
+      abort();
+    }
+    pagemap_modify(old + i, 0);
+  }
+
+  start = now_nsecs();
+  p = mremap(old, old_size, new_size, MREMAP_MAYMOVE);
+  count_syscall(start);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "mremap failed: %s (%d)\n",
+            strerror(errno), errno);
+    abort();
+  }
+  atomic_fetch_add_explicit(&remap_calls, 1, memory_order_relaxed);
+
+  for (i = 0; i < new_size; i += APAGE_SIZE)
+    pagemap_modify(p + i, 1);
+
+  if (new_size >= old_size) {
+    atomic_fetch_add_explicit(&page_count, (new_size - old_size) / APAGE_SIZE,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes_mapped, new_size - old_size,
+                              memory_order_relaxed);
+  } else {
+    atomic_fetch_sub_explicit(&page_count, (old_size - new_size) / APAGE_SIZE,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes_unmapped, old_size - new_size,
+                              memory_order_relaxed);
+  }
+
+  return p;
+}
+
+/*
+ * mem_reserve - set aside max bytes of contiguous address space without
+ *    making any of it accessible. Pages become usable, and count toward
+ *    mem_heapsize, only once they are passed to mem_commit.
+ */
+void *mem_reserve(size_t max)
+{
+  reservation *r;
+  void *p;
+  long start;
+
+  if (max & (APAGE_SIZE - 1)) {
+    fprintf(stderr, "mem_reserve: requested size is not a multiple of %d: %ld\n",
+            APAGE_SIZE, max);
+    abort();
+  }
+
+  start = now_nsecs();
+  p = mmap(0, max, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+  count_syscall(start);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "mmap failed: %s (%d)\n",
+            strerror(errno), errno);
+    abort();
+  }
+  atomic_fetch_add_explicit(&map_calls, 1, memory_order_relaxed);
+  count_mapping(1);
+
+  if ((r = malloc(sizeof(reservation))) == NULL) {
+    fprintf(stderr, "mem_reserve: out of memory\n");
+    abort();
+  }
+  r->base = p;
+  r->size = max;
+  r->next = atomic_load(&reservations);
+  while (!atomic_compare_exchange_weak(&reservations, &r->next, r))
+    ;
+
+  return p;
+}
+
+/*
+ * mem_commit - make len bytes at addr, which must lie inside a region
+ *    returned by mem_reserve, readable and writable
+ */
+void mem_commit(void *addr, size_t len)
+{
+  reservation *r;
+  size_t i;
+  long start;
+
+  if (((uintptr_t)addr) & (APAGE_SIZE - 1)) {
+    fprintf(stderr, "mem_commit: given address is not page-aligned: %p\n",
+            addr);
+    abort();
+  }
+
+  if (len & (APAGE_SIZE - 1)) {
+    fprintf(stderr, "mem_commit: given size is not a multiple of %d: %ld\n",
+            APAGE_SIZE, len);
+    abort();
+  }
+
+  for (r = atomic_load(&reservations); r != NULL; r = r->next)
+    if ((char *)addr >= r->base && (char *)addr + len <= r->base + r->size)
+      break;
+  if (r == NULL) {
+    fprintf(stderr, "mem_commit: range is not reserved: %p:%p\n",
+            addr, addr + len);
+    abort();
+  }
+
+  start = now_nsecs();
+  if (mprotect(addr, len, PROT_READ | PROT_WRITE) < 0) {
+    fprintf(stderr, "mprotect failed: %s (%d)\n",
+            strerror(errno), errno);
+    abort();
+  }
+#ifdef MADV_POPULATE_WRITE
+  if (map_flags & MAP_POPULATE)
+    madvise(addr, len, MADV_POPULATE_WRITE);
+#endif
+  count_syscall(start);
+  atomic_fetch_add_explicit(&commit_calls, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bytes_mapped, len, memory_order_relaxed);
+
+  for (i = 0; i < len; i += APAGE_SIZE)
+    pagemap_modify(addr + i, 1);
+  atomic_fetch_add_explicit(&page_count, len / APAGE_SIZE,
+                            memory_order_relaxed);
 }
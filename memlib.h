@@ -1,3 +1,6 @@
+#ifndef __MEMLIB_H_
+#define __MEMLIB_H_
+
 #include <unistd.h>
 
 void mem_init(void);               
@@ -6,5 +9,29 @@ void mem_reset(void);
 size_t mem_pagesize(void);
 void *mem_map(size_t);
 void mem_unmap(void *, size_t);
+void *mem_remap(void *, size_t, size_t);
+
+void *mem_reserve(size_t);
+void mem_commit(void *, size_t);
+
+void mem_set_prefault(int);
 
 size_t mem_heapsize(void);
+long mem_mappings(void);
+
+/* Counts of the requests memlib passed on to the kernel */
+typedef struct {
+  long map_calls;        /* mem_map and mem_reserve calls */
+  long unmap_calls;      /* mem_unmap calls */
+  long remap_calls;      /* mem_remap calls */
+  long commit_calls;     /* mem_commit calls */
+  size_t bytes_mapped;   /* bytes mapped, committed or grown by remap */
+  size_t bytes_unmapped; /* bytes unmapped or shrunk by remap */
+  long peak_mappings;    /* most mappings live at once */
+  double syscall_secs;   /* time spent in mmap, munmap, mremap, mprotect */
+} mem_stats_t;
+
+void mem_get_stats(mem_stats_t *);
+void mem_reset_stats(void);
+
+#endif /* __MEMLIB_H_ */
@@ -46,6 +46,16 @@
 // Combine a size and alloc bit
 #define PACK(size, alloc) ((size) | (alloc))
 
+// Requests at least this big get a mapping of their own, which
+// mm_realloc can grow with mem_remap instead of copying
+#define LARGE_THRESHOLD (1 << 16)
+
+// Allocation state of a block that owns its whole mapping
+#define LARGE_BLOCK 2
+
+// Address space reserved up front so that the heap can grow in place
+#define HEAP_RESERVE ((size_t)1 << 32)
+
 // Given a payload pointer, get the next or previous payload pointer
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
 #define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE((char *)(bp)-OVERHEAD))
@@ -54,9 +64,21 @@
 static void *set_allocated(void *b, size_t size);
 static void extend(size_t s);
 static void remove_block_from_list(void* allocated, void *free_block);
+static void unlink_block(void *b);
 static void set_new_free_block(void *free_block);
 static void *find_block(void *free_block, size_t);
+static void *large_malloc(size_t size);
+static int extend_in_place(size_t size);
+
+// check_free_list prints the whole free list to stdout, so it only
+// runs where DEBUG_FREE_LIST is defined: in the driver's build, not
+// in libmmpreload.so, which shares stdout with the program it runs
+#ifdef DEBUG_FREE_LIST
 static void check_free_list();
+#define CHECK_FREE_LIST() check_free_list()
+#else
+#define CHECK_FREE_LIST()
+#endif
 
 // Struct that will hold the list of pages
 typedef struct free_list
@@ -72,6 +94,9 @@ void *head_free_list; // head of the list
 int current_avail_size = 0;
 void *current_avail;
 
+void *heap_start = NULL; // reserved region for the contiguous heap
+void *heap_end = NULL;   // end of the committed part of that region
+
 typedef struct
 {
   size_t size;
@@ -94,17 +119,23 @@ int mm_init(void)
   // reset the allocator
   head = NULL; 
   current_avail_size = 0;
+  heap_start = NULL;
+  heap_end = NULL;
   return 0;
 }
 
 void *mm_malloc(size_t size)
 {
 
-  check_free_list();
+  CHECK_FREE_LIST();
   if (size == 0)
   {
     return NULL;
   }
+  if (ALIGN(size + OVERHEAD) >= LARGE_THRESHOLD)
+  {
+    return large_malloc(size);
+  }
   if (head == NULL)
   {
     extend(size);
@@ -149,17 +180,45 @@ static void *set_allocated(void *b, size_t size)
     GET_ALLOC(HDRP(NEXT_BLKP(b))) = 0;
     GET_SIZE(FTRP(NEXT_BLKP(b))) = extra_size;
   }
+  else
+  {
+    // the whole block is used; its neighbour may be allocated or the
+    // terminator, whose payload lies past the committed heap
+    size = GET_SIZE(HDRP(b));
+    GET_ALLOC(HDRP(b)) = 1;
+    GET_SIZE(FTRP(b)) = size;
+    unlink_block(b);
+    return b;
+  }
   GET_ALLOC(HDRP(b)) = 1;
   GET_SIZE(FTRP(b)) = size; 
   void *new_free_block = NEXT_BLKP(b);
   int alloc = GET_ALLOC(HDRP(new_free_block));
   int ss = GET_SIZE(HDRP(new_free_block));
-  check_free_list();
+  CHECK_FREE_LIST();
   remove_block_from_list(b, new_free_block);
 
   return b;
 }
 
+static void unlink_block(void *b)
+{
+  free_list *block = b;
+  if (block->prev != NULL)
+  {
+    block->prev->next = block->next;
+  }
+  else
+  {
+    head = block->next;
+  }
+  if (block->next != NULL)
+  {
+    block->next->prev = block->prev;
+  }
+  CHECK_FREE_LIST();
+}
+
 static void extend(size_t s)
 {
   /**
@@ -172,7 +231,25 @@ static void extend(size_t s)
 
   //int newsize = ALIGN(s + OVERHEAD); Use this inside malloc
   current_avail_size = PAGE_ALIGN(s*4 + OVERHEAD + 16);
-  void *new_page = mem_map(current_avail_size);
+  if (extend_in_place(current_avail_size))
+  {
+    return;
+  }
+
+  void *new_page;
+  if (heap_start == NULL)
+  {
+    // first chunk of the contiguous heap
+    heap_start = mem_reserve(HEAP_RESERVE);
+    mem_commit(heap_start, current_avail_size);
+    heap_end = (char *)heap_start + current_avail_size;
+    new_page = heap_start;
+  }
+  else
+  {
+    // the reservation is used up, start a separate chunk
+    new_page = mem_map(current_avail_size);
+  }
   new_page += 16;
   GET_ALLOC(HDRP(new_page)) = 1; // prolog header block
   GET_SIZE(HDRP(new_page)) = 32;
@@ -195,14 +272,68 @@ static void extend(size_t s)
     head = new_page;
     head->next = NULL;
     head->prev = NULL;
-    check_free_list();
+    CHECK_FREE_LIST();
   }
 
   else
   {
     set_new_free_block(new_page);
-    check_free_list();
+    CHECK_FREE_LIST();
+  }
+}
+
+static int extend_in_place(size_t size)
+{
+  /**
+   * Commit size more bytes at the end of the contiguous heap. The old
+   * terminator becomes the header of the new free block, so the heap
+   * needs no new prologue, and a free block that ended the heap
+   * simply grows.
+   */
+  if (heap_start == NULL || (char *)heap_end + size > (char *)heap_start + HEAP_RESERVE)
+  {
+    return 0;
+  }
+
+  mem_commit(heap_end, size);
+  void *new_block = heap_end;
+  heap_end = (char *)heap_end + size;
+
+  void *prev = PREV_BLKP(new_block);
+  if (!GET_ALLOC(HDRP(prev)))
+  {
+    // coalesce with the free block that ended the heap
+    GET_SIZE(HDRP(prev)) += size;
+    GET_SIZE(FTRP(prev)) = GET_SIZE(HDRP(prev));
+    new_block = prev;
+  }
+  else
+  {
+    GET_SIZE(HDRP(new_block)) = size;
+    GET_ALLOC(HDRP(new_block)) = 0;
+    GET_SIZE(FTRP(new_block)) = size;
+  }
+
+  GET_ALLOC(HDRP(NEXT_BLKP(new_block))) = 1; // terminator
+  GET_SIZE(HDRP(NEXT_BLKP(new_block))) = 0;
+
+  if (new_block == prev)
+  {
+    CHECK_FREE_LIST();
+  }
+  else if (head == NULL)
+  {
+    head = new_block;
+    head->next = NULL;
+    head->prev = NULL;
+    CHECK_FREE_LIST();
   }
+  else
+  {
+    set_new_free_block(new_block);
+    CHECK_FREE_LIST();
+  }
+  return 1;
 }
 
 static void remove_block_from_list(void* allocated, void *free_block)
@@ -210,7 +341,7 @@ static void remove_block_from_list(void* allocated, void *free_block)
 
   int allocation = GET_ALLOC(HDRP(free_block));
   int ss = GET_SIZE(HDRP(free_block));
-  int allocation = GET_ALLOC(HDRP(allocated));
+  int allocation2 = GET_ALLOC(HDRP(allocated));
   int ss2 = GET_SIZE(HDRP(allocated));
   free_list *current = head;
   if(allocated == head)
@@ -220,7 +351,7 @@ static void remove_block_from_list(void* allocated, void *free_block)
     head = f;
     head->next = head_next;
     head->prev = NULL; 
-    check_free_list();
+    CHECK_FREE_LIST();
     return; 
   }
 
@@ -232,7 +363,7 @@ static void remove_block_from_list(void* allocated, void *free_block)
   allocated_prev->next = free; 
   free->prev = allocated_prev;
   free->next = allocated_next; 
-  check_free_list();
+  CHECK_FREE_LIST();
   return; 
 
 }
@@ -271,20 +402,79 @@ static void set_new_free_block(void *free_block)
   block->next = NULL;
   int alloc = GET_ALLOC(HDRP(block));
   int size = GET_SIZE(HDRP(block));
-  check_free_list(); 
+  CHECK_FREE_LIST(); 
   return;
 }
 
 
 
+static void *large_malloc(size_t size)
+{
+  /**
+   * A large block is a page-aligned mapping that starts with a
+   * header holding the size of the whole mapping, so the payload
+   * stays 16-byte aligned.
+   */
+  size_t mapped_size = PAGE_ALIGN(size + sizeof(block_header));
+  void *bp = (char *)mem_map(mapped_size) + sizeof(block_header);
+  GET_SIZE(HDRP(bp)) = mapped_size;
+  GET_ALLOC(HDRP(bp)) = LARGE_BLOCK;
+  return bp;
+}
+
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - Large blocks are unmapped, freeing anything else does nothing.
  */
 void mm_free(void *ptr)
 {
+  if (ptr != NULL && GET_ALLOC(HDRP(ptr)) == LARGE_BLOCK)
+  {
+    mem_unmap(HDRP(ptr), GET_SIZE(HDRP(ptr)));
+  }
   return;
 }
 
+/*
+ * mm_realloc - Large blocks are resized with mem_remap, which moves
+ *     page tables instead of bytes. Others are copied to a new block.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+  if (ptr == NULL)
+  {
+    return mm_malloc(size);
+  }
+  if (size == 0)
+  {
+    mm_free(ptr);
+    return NULL;
+  }
+
+  if (GET_ALLOC(HDRP(ptr)) == LARGE_BLOCK)
+  {
+    size_t old_size = GET_SIZE(HDRP(ptr));
+    size_t new_size = PAGE_ALIGN(size + sizeof(block_header));
+    if (new_size == old_size)
+    {
+      return ptr;
+    }
+    void *bp = (char *)mem_remap(HDRP(ptr), old_size, new_size) + sizeof(block_header);
+    GET_SIZE(HDRP(bp)) = new_size;
+    return bp;
+  }
+
+  size_t old_payload = GET_SIZE(HDRP(ptr)) - OVERHEAD;
+  void *newp = mm_malloc(size);
+  if (newp == NULL)
+  {
+    return NULL;
+  }
+  memcpy(newp, ptr, old_payload < size ? old_payload : size);
+  mm_free(ptr);
+  return newp;
+}
+
+#ifdef DEBUG_FREE_LIST
 static void check_free_list()
 {
   int index = 0;
@@ -306,3 +496,4 @@ static void check_free_list()
     index++;
   }
 }
+#endif
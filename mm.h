@@ -3,3 +3,11 @@
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+extern void *mm_realloc(void *ptr, size_t size);
+
+/*
+ * Set to 1 once mm_malloc, mm_free and mm_realloc may be called from
+ * several threads at once. Until then, the multithreaded replay in
+ * mdriver (-M) holds a lock around every call.
+ */
+#define MM_THREAD_SAFE 0
@@ -0,0 +1,642 @@
+/*
+ * mmcapture.c - record the allocations of a real program as a trace
+ *
+ * Build libmmcapture.so with "make" and run a program with
+ *     MMCAPTURE_OUT=prog.%p.rep LD_PRELOAD=./libmmcapture.so prog ...
+ * to write its malloc, free, realloc and calloc calls to prog.<pid>.rep
+ * when it exits (mmcapture.<pid>.rep if MMCAPTURE_OUT is not set).
+ *
+ * Each call appends an event to a buffer of the calling thread, with
+ * no locks; full buffers are pushed on a lock-free list that a
+ * background thread writes to a raw file. Events are ordered by a
+ * global atomic sequence number, taken before a block is released and
+ * after one is acquired, so that the order never shows an address in
+ * use twice. A realloc releases its old block and then acquires its
+ * new one, and so has an event for each.
+ *
+ * At exit recording stops, and each buffer is written out once the
+ * thread that owns it has left record(); a thread that reaches
+ * record() after that drops its event. The raw events are then sorted, addresses are turned into dense
+ * ids, every block still live is freed, and the result is written as
+ * a text trace with a "t <tid>" line wherever the thread changes.
+ * Frees of blocks the program got some other way (before the library
+ * was loaded, or from memalign and friends) are dropped, and a
+ * zero-byte request is written as one byte, since mdriver takes a
+ * NULL from mm_malloc as a failure. A child made by fork is not
+ * recorded.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define CAP_BUF_EVENTS 16384      /* events per thread buffer */
+#define CAP_WRITE_NSECS 10000000  /* the writer wakes every 10 ms */
+#define MAXLINE 1024
+
+/* glibc's own allocator, which the wrappers forward to */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+/* Kinds of events */
+enum {
+    EV_ALLOC,         /* ptr was acquired with size bytes */
+    EV_FREE,          /* ptr is about to be released */
+    EV_REALLOC_OLD,   /* a realloc is about to release ptr */
+    EV_REALLOC_NEW    /* ... and acquired ptr with size bytes */
+};
+#define REALLOC_FAILED UINT64_MAX /* size of a realloc that kept ptr */
+
+typedef struct {
+    uint64_t seq;
+    uint32_t tid;
+    uint32_t type;
+    uint64_t ptr;
+    uint64_t size;
+} cap_event_t;
+
+/* A thread's buffer of events */
+typedef struct cap_buf {
+    struct cap_buf *next_full;   /* on the list of full buffers */
+    struct cap_buf *next_all;    /* on the list of every buffer */
+    int count;
+    atomic_int busy;             /* is its thread inside record()? */
+    cap_event_t events[CAP_BUF_EVENTS];
+} cap_buf_t;
+
+static atomic_int capturing = 0;        /* recording events? */
+static atomic_uint_fast64_t next_seq = 0;
+static atomic_int next_tid = 0;
+static _Atomic(cap_buf_t *) full_bufs = NULL;
+static _Atomic(cap_buf_t *) all_bufs = NULL;
+static atomic_int writer_stop = 0;
+static pthread_t writer;
+static int raw_fd = -1;
+static char out_path[MAXLINE];
+static char raw_path[MAXLINE + 8];
+
+/* Initial-exec TLS, so that reaching it never calls malloc */
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+static TLS int in_shim = 0;             /* inside a wrapper or the writer */
+static TLS int my_tid = -1;
+static TLS cap_buf_t *my_buf = NULL;
+
+/*
+ * cap_error - Report an error and stop recording
+ */
+static void cap_error(char *msg)
+{
+    fprintf(stderr, "mmcapture: %s: %s\n", msg, strerror(errno));
+    atomic_store(&capturing, 0);
+}
+
+/*
+ * new_buf - Map a fresh buffer and put it on the list of every buffer
+ */
+static cap_buf_t *new_buf(void)
+{
+    cap_buf_t *b;
+
+    b = mmap(NULL, sizeof(cap_buf_t), PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b == MAP_FAILED)
+	return NULL;
+    b->count = 0;
+    atomic_init(&b->busy, 0);
+    b->next_full = NULL;
+    b->next_all = atomic_load(&all_bufs);
+    while (!atomic_compare_exchange_weak(&all_bufs, &b->next_all, b))
+	;
+    return b;
+}
+
+/*
+ * record - Append an event to the calling thread's buffer, and hand
+ *     the buffer to the writer once it is full. The buffer is marked
+ *     busy while the event goes in, and the event is dropped if
+ *     recording has stopped, so that finish never writes a buffer
+ *     halfway through an append.
+ */
+static void record(int type, uint64_t seq, void *ptr, uint64_t size)
+{
+    cap_buf_t *b = my_buf;
+    cap_event_t *e;
+
+    if (b == NULL || b->count == CAP_BUF_EVENTS) {
+	if (b != NULL) {
+	    b->next_full = atomic_load(&full_bufs);
+	    while (!atomic_compare_exchange_weak(&full_bufs, &b->next_full, b))
+		;
+	}
+	if ((my_buf = b = new_buf()) == NULL) {
+	    cap_error("mmap failed in record");
+	    return;
+	}
+    }
+    atomic_store(&b->busy, 1);
+    if (!atomic_load(&capturing)) {
+	atomic_store(&b->busy, 0);
+	return;
+    }
+    if (my_tid < 0)
+	my_tid = atomic_fetch_add(&next_tid, 1);
+    e = &b->events[b->count];
+    e->seq = seq;
+    e->tid = my_tid;
+    e->type = type;
+    e->ptr = (uintptr_t)ptr;
+    e->size = size;
+    b->count++;
+    atomic_store(&b->busy, 0);
+}
+
+/*
+ * seq - Take the next sequence number
+ */
+static uint64_t seq(void)
+{
+    return atomic_fetch_add(&next_seq, 1);
+}
+
+/*
+ * write_buf - Append a buffer's events to the raw file
+ */
+static void write_buf(cap_buf_t *b)
+{
+    char *p = (char *)b->events;
+    size_t left = b->count * sizeof(cap_event_t);
+    ssize_t n;
+
+    while (left > 0) {
+	if ((n = write(raw_fd, p, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    cap_error("write failed in write_buf");
+	    return;
+	}
+	p += n;
+	left -= n;
+    }
+    b->count = 0;
+}
+
+/*
+ * write_full - Write the full buffers handed over so far. A written
+ *     buffer stays on the list of every buffer, empty, and is not
+ *     used again; the pages past its first are given back.
+ */
+static void write_full(void)
+{
+    cap_buf_t *b = atomic_exchange(&full_bufs, NULL);
+    long page = sysconf(_SC_PAGESIZE);
+
+    for (; b != NULL; b = b->next_full) {
+	write_buf(b);
+	madvise((char *)b + page, sizeof(cap_buf_t) - page, MADV_DONTNEED);
+    }
+}
+
+/*
+ * writer_thread - Write full buffers in the background
+ */
+static void *writer_thread(void *arg)
+{
+    struct timespec ts = {0, CAP_WRITE_NSECS};
+
+    in_shim = 1;
+    while (!atomic_load(&writer_stop)) {
+	write_full();
+	nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * cmp_seq - qsort comparison of events by sequence number
+ */
+static int cmp_seq(const void *a, const void *b)
+{
+    uint64_t x = ((cap_event_t *)a)->seq, y = ((cap_event_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Map from live addresses to ids, with open addressing. A key of 0
+ * is an empty slot and a value of -1 a removed one.
+ */
+typedef struct {
+    uint64_t *keys;
+    int *vals;
+    size_t mask;
+    size_t used;
+} addrmap_t;
+
+static size_t addr_hash(addrmap_t *m, uint64_t a)
+{
+    return ((a >> 4) * 0x9e3779b97f4a7c15ULL >> 20) & m->mask;
+}
+
+static void map_init(addrmap_t *m, size_t slots)
+{
+    m->keys = calloc(slots, sizeof(uint64_t));
+    m->vals = malloc(slots * sizeof(int));
+    m->mask = slots - 1;
+    m->used = 0;
+    if (m->keys == NULL || m->vals == NULL) {
+	perror("mmcapture: malloc failed in map_init");
+	exit(1);
+    }
+}
+
+static int *map_slot(addrmap_t *m, uint64_t a, int insert)
+{
+    size_t i = addr_hash(m, a);
+    int *removed = NULL;
+
+    for (; m->keys[i] != 0; i = (i + 1) & m->mask) {
+	if (m->keys[i] == a && m->vals[i] >= 0)
+	    return &m->vals[i];
+	if (m->vals[i] < 0 && removed == NULL)
+	    removed = &m->vals[i];
+    }
+    if (!insert)
+	return NULL;
+    if (removed != NULL) {
+	m->keys[removed - m->vals] = a;
+	return removed;
+    }
+    m->keys[i] = a;
+    m->used++;
+    return &m->vals[i];
+}
+
+static void map_put(addrmap_t *m, uint64_t a, int id);
+
+static void map_grow(addrmap_t *m)
+{
+    addrmap_t old = *m;
+    size_t i;
+
+    map_init(m, 2 * (old.mask + 1));
+    for (i = 0; i <= old.mask; i++)
+	if (old.keys[i] != 0 && old.vals[i] >= 0)
+	    map_put(m, old.keys[i], old.vals[i]);
+    free(old.keys);
+    free(old.vals);
+}
+
+static void map_put(addrmap_t *m, uint64_t a, int id)
+{
+    if (2 * (m->used + 1) > m->mask + 1)
+	map_grow(m);
+    *map_slot(m, a, 1) = id;
+}
+
+/* Trace being built from the events */
+typedef struct {
+    traceop_t *ops;
+    int num_ops, max_ops;
+    int num_ids, max_ids;
+    char *live;           /* is id live? */
+    int *sizes;           /* size of each id */
+    double live_bytes, peak_bytes;
+} out_t;
+
+static void out_op(out_t *t, int type, int id, int size, int tid)
+{
+    traceop_t *op;
+
+    if (t->num_ops == t->max_ops) {
+	t->max_ops = t->max_ops ? 2 * t->max_ops : 65536;
+	if ((t->ops = realloc(t->ops, t->max_ops * sizeof(traceop_t))) == NULL) {
+	    perror("mmcapture: realloc failed in out_op");
+	    exit(1);
+	}
+    }
+    op = &t->ops[t->num_ops++];
+    op->type = type;
+    op->index = id;
+    op->size = size;
+    op->tid = tid;
+
+    if (type != ALLOC)
+	t->live_bytes -= t->sizes[id];
+    if (type == FREE)
+	t->live[id] = 0;
+    else {
+	t->sizes[id] = size;
+	t->live[id] = 1;
+	t->live_bytes += size;
+	if (t->live_bytes > t->peak_bytes)
+	    t->peak_bytes = t->live_bytes;
+    }
+}
+
+static int out_id(out_t *t)
+{
+    if (t->num_ids == t->max_ids) {
+	t->max_ids = t->max_ids ? 2 * t->max_ids : 65536;
+	if ((t->live = realloc(t->live, t->max_ids)) == NULL
+	    || (t->sizes = realloc(t->sizes, t->max_ids * sizeof(int))) == NULL) {
+	    perror("mmcapture: realloc failed in out_id");
+	    exit(1);
+	}
+    }
+    t->live[t->num_ids] = 0;
+    return t->num_ids++;
+}
+
+/* A size as the trace stores it */
+static int trace_size(uint64_t size)
+{
+    if (size == 0)
+	return 1;
+    return (size > INT_MAX) ? INT_MAX : (int)size;
+}
+
+/*
+ * convert - Turn the sorted events into a balanced trace
+ */
+static void convert(cap_event_t *ev, size_t n, int ntids, out_t *t,
+		    long *dropped)
+{
+    addrmap_t map;
+    int *pending, *slot, id;
+    size_t i;
+
+    map_init(&map, 1 << 16);
+    if ((pending = malloc((ntids + 1) * sizeof(int))) == NULL) {
+	perror("mmcapture: malloc failed in convert");
+	exit(1);
+    }
+    for (i = 0; i < ntids; i++)
+	pending[i] = -1;
+
+    for (i = 0; i < n; i++) {
+	switch (ev[i].type) {
+	case EV_ALLOC:
+	    /* A clash means a block was lost track of; it stays live */
+	    id = out_id(t);
+	    out_op(t, ALLOC, id, trace_size(ev[i].size), ev[i].tid);
+	    map_put(&map, ev[i].ptr, id);
+	    break;
+
+	case EV_FREE:
+	case EV_REALLOC_OLD:
+	    id = -1;
+	    if (ev[i].ptr != 0 && (slot = map_slot(&map, ev[i].ptr, 0))) {
+		id = *slot;
+		*slot = -1;
+	    }
+	    else if (ev[i].ptr != 0)
+		(*dropped)++;
+	    if (ev[i].type == EV_REALLOC_OLD)
+		pending[ev[i].tid] = id;
+	    else if (id >= 0)
+		out_op(t, FREE, id, 0, ev[i].tid);
+	    break;
+
+	case EV_REALLOC_NEW:
+	    id = pending[ev[i].tid];
+	    pending[ev[i].tid] = -1;
+	    if (ev[i].size == REALLOC_FAILED) {
+		if (id >= 0)
+		    map_put(&map, ev[i].ptr, id);
+	    }
+	    else if (ev[i].ptr == 0) {
+		if (id >= 0)
+		    out_op(t, FREE, id, 0, ev[i].tid);
+	    }
+	    else {
+		if (id < 0)
+		    out_op(t, ALLOC, id = out_id(t), trace_size(ev[i].size),
+			   ev[i].tid);
+		else
+		    out_op(t, REALLOC, id, trace_size(ev[i].size), ev[i].tid);
+		map_put(&map, ev[i].ptr, id);
+	    }
+	    break;
+	}
+    }
+
+    /* Free whatever is still live, on the thread that started */
+    for (id = 0; id < t->num_ids; id++)
+	if (t->live[id])
+	    out_op(t, FREE, id, 0, 0);
+
+    free(map.keys);
+    free(map.vals);
+    free(pending);
+}
+
+/*
+ * write_rep - Write the trace in the text format
+ */
+static void write_rep(out_t *t, char *path)
+{
+    FILE *f;
+    traceop_t *op;
+    int i, tid = 0;
+
+    if ((f = fopen(path, "w")) == NULL) {
+	fprintf(stderr, "mmcapture: could not create %s: %s\n", path,
+		strerror(errno));
+	return;
+    }
+    fprintf(f, "%.0f\n%d\n%d\n1\n", t->peak_bytes + 100, t->num_ids,
+	    t->num_ops);
+    for (i = 0; i < t->num_ops; i++) {
+	op = &t->ops[i];
+	if (op->tid != tid)
+	    fprintf(f, "t %d\n", tid = op->tid);
+	if (op->type == ALLOC)
+	    fprintf(f, "a %d %d\n", op->index, op->size);
+	else if (op->type == REALLOC)
+	    fprintf(f, "r %d %d\n", op->index, op->size);
+	else
+	    fprintf(f, "f %d\n", op->index);
+    }
+    if (fclose(f) != 0)
+	fprintf(stderr, "mmcapture: could not write %s: %s\n", path,
+		strerror(errno));
+}
+
+/*
+ * finish - Stop recording and write the trace
+ */
+static void finish(void)
+{
+    struct stat st;
+    cap_buf_t *b;
+    cap_event_t *ev;
+    out_t t;
+    long dropped = 0;
+    size_t n;
+
+    in_shim = 1;
+    if (!atomic_exchange(&capturing, 0))
+	return;
+    atomic_store(&writer_stop, 1);
+    pthread_join(writer, NULL);
+
+    /* Write the full buffers, then the partly filled ones */
+    write_full();
+    for (b = atomic_load(&all_bufs); b != NULL; b = b->next_all) {
+	while (atomic_load(&b->busy))
+	    sched_yield();
+	write_buf(b);
+    }
+
+    if (fstat(raw_fd, &st) < 0) {
+	perror("mmcapture: fstat failed in finish");
+	return;
+    }
+    n = st.st_size / sizeof(cap_event_t);
+    ev = n ? mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		  raw_fd, 0) : NULL;
+    if (ev == MAP_FAILED) {
+	perror("mmcapture: mmap failed in finish");
+	return;
+    }
+    qsort(ev, n, sizeof(cap_event_t), cmp_seq);
+
+    memset(&t, 0, sizeof(t));
+    convert(ev, n, atomic_load(&next_tid), &t, &dropped);
+    write_rep(&t, out_path);
+    if (dropped)
+	fprintf(stderr, "mmcapture: dropped %ld frees of unknown blocks\n",
+		dropped);
+
+    if (ev)
+	munmap(ev, st.st_size);
+    close(raw_fd);
+    unlink(raw_path);
+    free(t.ops);
+    free(t.live);
+    free(t.sizes);
+}
+
+/*
+ * stop_in_child - A forked child has no writer thread; don't record it
+ */
+static void stop_in_child(void)
+{
+    atomic_store(&capturing, 0);
+}
+
+/*
+ * init - Open the raw file and start the writer
+ */
+__attribute__((constructor))
+static void init(void)
+{
+    char *p, *env = getenv("MMCAPTURE_OUT");
+    size_t len = 0;
+
+    in_shim = 1;
+    if (env == NULL)
+	env = "mmcapture.%p.rep";
+    /* Replace every %p with the pid */
+    for (p = env; *p && len < MAXLINE - 16; p++) {
+	if (p[0] == '%' && p[1] == 'p') {
+	    len += sprintf(out_path + len, "%d", (int)getpid());
+	    p++;
+	}
+	else
+	    out_path[len++] = *p;
+    }
+    out_path[len] = '\0';
+    sprintf(raw_path, "%s.raw", out_path);
+
+    if ((raw_fd = open(raw_path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
+	cap_error("could not create the raw event file");
+	in_shim = 0;
+	return;
+    }
+    if ((errno = pthread_create(&writer, NULL, writer_thread, NULL)) != 0) {
+	cap_error("pthread_create failed in init");
+	in_shim = 0;
+	return;
+    }
+    pthread_atfork(NULL, NULL, stop_in_child);
+    atexit(finish);
+    atomic_store(&capturing, 1);
+    in_shim = 0;
+}
+
+/*
+ * The wrappers. Calls made while in_shim is set, by the library
+ * itself or by libc on its behalf, are passed through unrecorded.
+ */
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (in_shim || !atomic_load_explicit(&capturing, memory_order_relaxed))
+	return __libc_malloc(size);
+    in_shim = 1;
+    if ((p = __libc_malloc(size)) != NULL)
+	record(EV_ALLOC, seq(), p, size);
+    in_shim = 0;
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (in_shim || !atomic_load_explicit(&capturing, memory_order_relaxed))
+	return __libc_calloc(nmemb, size);
+    in_shim = 1;
+    if ((p = __libc_calloc(nmemb, size)) != NULL)
+	record(EV_ALLOC, seq(), p, (uint64_t)nmemb * size);
+    in_shim = 0;
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (in_shim || !atomic_load_explicit(&capturing, memory_order_relaxed))
+	return __libc_realloc(ptr, size);
+    in_shim = 1;
+    record(EV_REALLOC_OLD, seq(), ptr, 0);
+    p = __libc_realloc(ptr, size);
+    if (p == NULL && size != 0)
+	record(EV_REALLOC_NEW, seq(), ptr, REALLOC_FAILED);
+    else
+	record(EV_REALLOC_NEW, seq(), p, size);
+    in_shim = 0;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    if (in_shim || !atomic_load_explicit(&capturing, memory_order_relaxed)) {
+	__libc_free(ptr);
+	return;
+    }
+    in_shim = 1;
+    record(EV_FREE, seq(), ptr, 0);
+    __libc_free(ptr);
+    in_shim = 0;
+}
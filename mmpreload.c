@@ -0,0 +1,294 @@
+/*
+ * mmpreload.c - run real programs on the mm package
+ *
+ * libmmpreload.so holds this file, mm.c and the memory system, and
+ * replaces the C library's allocator when preloaded:
+ *     LD_PRELOAD=./libmmpreload.so prog ...
+ *
+ * Every block starts with a header that holds its requested size,
+ * for malloc_usable_size, and its distance from the pointer that
+ * mm_malloc returned, so that blocks of any alignment are freed the
+ * same way. Blocks are aligned to 16 bytes, as glibc's are.
+ *
+ * mm.c and memlib.c call malloc and printf themselves, so a thread
+ * that is inside the mm package has its own allocations served by the
+ * C library instead. A block is only passed to mm_free if memlib's
+ * page map says it lies in memory mapped for the package; anything
+ * else came from the C library, here or before the library was
+ * loaded, and goes back to it. Until mm.h sets MM_THREAD_SAFE, every
+ * call into the package holds a lock, which fork takes too, so that a
+ * child is never left with it held.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <dlfcn.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "pagemap.h"
+
+#define MIN_ALIGN 16
+
+/* glibc's own allocator, for calls made from inside the mm package */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+/* Header in front of every block */
+typedef struct {
+    size_t size;    /* bytes requested */
+    size_t offset;  /* from the start of the mm block to the payload */
+} header_t;
+
+#define HEADER(p) ((header_t *)(p) - 1)
+
+/* Did the mm package allocate p? */
+#define FROM_MM(p) (pagemap_is_mapped(p))
+
+/* Initial-exec TLS, so that reaching it never calls malloc */
+static __thread __attribute__((tls_model("initial-exec"))) int in_mm = 0;
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int initialized = 0;
+
+/*
+ * enter, leave - Bracket a call into the mm package. The first call
+ *     initializes the package.
+ */
+static void enter(void)
+{
+    in_mm = 1;
+    if (!MM_THREAD_SAFE || !initialized)
+	pthread_mutex_lock(&mm_lock);
+    if (!initialized) {
+	mem_init();
+	if (mm_init() < 0) {
+	    fprintf(stderr, "mmpreload: mm_init failed\n");
+	    abort();
+	}
+	initialized = 1;
+	if (MM_THREAD_SAFE)
+	    pthread_mutex_unlock(&mm_lock);
+    }
+}
+
+static void leave(void)
+{
+    if (!MM_THREAD_SAFE)
+	pthread_mutex_unlock(&mm_lock);
+    in_mm = 0;
+}
+
+/*
+ * fork_prepare, fork_parent, fork_child - Hold mm_lock across fork, so
+ *     that the child never inherits it held by a thread that does not
+ *     exist there
+ */
+static void fork_prepare(void)
+{
+    pthread_mutex_lock(&mm_lock);
+}
+
+static void fork_parent(void)
+{
+    pthread_mutex_unlock(&mm_lock);
+}
+
+static void fork_child(void)
+{
+    pthread_mutex_unlock(&mm_lock);
+}
+
+__attribute__((constructor))
+static void register_fork_handlers(void)
+{
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+/*
+ * mm_alloc_aligned - Allocate size bytes aligned to align (a power of
+ *     two of at least MIN_ALIGN) from the mm package
+ */
+static void *mm_alloc_aligned(size_t size, size_t align)
+{
+    char *raw, *p;
+
+    if (size > SIZE_MAX - sizeof(header_t) - align) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    enter();
+    raw = NULL;
+    if (align == MIN_ALIGN) {
+	/* Most packages align their blocks well enough already */
+	raw = mm_malloc(size + sizeof(header_t));
+	if (raw != NULL && ((uintptr_t)raw + sizeof(header_t)) % align != 0) {
+	    mm_free(raw);
+	    raw = NULL;
+	}
+    }
+    if (raw == NULL)
+	raw = mm_malloc(size + sizeof(header_t) + align - 1);
+    leave();
+    if (raw == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    p = (char *)(((uintptr_t)raw + sizeof(header_t) + align - 1)
+		 & ~(uintptr_t)(align - 1));
+    HEADER(p)->size = size;
+    HEADER(p)->offset = p - raw;
+    return p;
+}
+
+/*
+ * The allocator's entry points
+ */
+void *malloc(size_t size)
+{
+    if (in_mm)
+	return __libc_malloc(size);
+    return mm_alloc_aligned(size, MIN_ALIGN);
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    if (in_mm || !FROM_MM(ptr)) {
+	__libc_free(ptr);
+	return;
+    }
+    enter();
+    mm_free((char *)ptr - HEADER(ptr)->offset);
+    leave();
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (in_mm)
+	return __libc_calloc(nmemb, size);
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if ((p = mm_alloc_aligned(nmemb * size, MIN_ALIGN)) != NULL)
+	memset(p, 0, nmemb * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    char *raw, *p;
+    size_t offset;
+
+    if (in_mm || (ptr != NULL && !FROM_MM(ptr)))
+	return __libc_realloc(ptr, size);
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    if (size > SIZE_MAX - sizeof(header_t) - MIN_ALIGN) {
+	errno = ENOMEM;
+	return NULL;
+    }
+
+    /* Let mm_realloc move a block that is aligned the usual way */
+    offset = HEADER(ptr)->offset;
+    if (offset == sizeof(header_t)) {
+	enter();
+	raw = mm_realloc((char *)ptr - offset, size + sizeof(header_t));
+	leave();
+	if (raw == NULL) {
+	    errno = ENOMEM;
+	    return NULL;
+	}
+	if (((uintptr_t)raw + offset) % MIN_ALIGN == 0) {
+	    p = raw + offset;
+	    HEADER(p)->size = size;
+	    return p;
+	}
+	ptr = raw + offset;  /* misaligned; copy it below */
+    }
+
+    if ((p = mm_alloc_aligned(size, MIN_ALIGN)) == NULL)
+	return NULL;
+    memcpy(p, ptr, (HEADER(ptr)->size < size) ? HEADER(ptr)->size : size);
+    free(ptr);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)))
+	return EINVAL;
+    if (in_mm) {
+	p = __libc_memalign(alignment, size);
+    }
+    else
+	p = mm_alloc_aligned(size, (alignment < MIN_ALIGN) ? MIN_ALIGN
+			     : alignment);
+    if (p == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    if (in_mm)
+	return __libc_memalign(alignment, size);
+    if (alignment & (alignment - 1)) {
+	errno = EINVAL;
+	return NULL;
+    }
+    return mm_alloc_aligned(size, (alignment < MIN_ALIGN) ? MIN_ALIGN
+			    : alignment);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    static size_t (*libc_usable_size)(void *) = NULL;
+
+    if (ptr == NULL)
+	return 0;
+    if (!FROM_MM(ptr)) {
+	if (libc_usable_size == NULL) {
+	    in_mm = 1;  /* dlsym may allocate */
+	    libc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+	    in_mm = 0;
+	}
+	return libc_usable_size(ptr);
+    }
+    return HEADER(ptr)->size;
+}
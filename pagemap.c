@@ -1,19 +1,39 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "pagemap.h"
 
 /* Keep track of all mapped pages so that we can easily get a list of
-   all of them --- but also efficiently add and remove from the list. */
+   all of them --- but also efficiently add and remove from the list.
+
+   Lookups are lock-free: the radix levels are installed with
+   compare-and-swap and never freed, and a page's addr field is read
+   atomically. Changes to a page take the lock of the shard that owns
+   it, and each shard keeps its own list of mapped pages, so threads
+   mapping unrelated pages rarely contend. */
 
 typedef struct mpage {
-  void *addr;
+  _Atomic(void *) addr;
   struct mpage *prev, *next;
 } mpage;
 
-static mpage *all_mapped_pages;
+typedef _Atomic(mpage *) mpage_ptr;       /* level 2 entry */
+typedef _Atomic(mpage_ptr *) level2_ptr;  /* level 1 entry */
+
+#define PAGEMAP_SHARDS 64
+
+/* pad each shard to a cache line so that shard locks don't share one */
+typedef struct {
+  pthread_mutex_t lock;
+  mpage *all_mapped_pages;
+} __attribute__((aligned(64))) shard;
+
+static shard shards[PAGEMAP_SHARDS];
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
 
-static mpage ***page_maps1;
+static _Atomic(level2_ptr *) page_maps1;
 
 #define PAGEMAP64_LEVEL1_SIZE (1 << 16)
 #define PAGEMAP64_LEVEL2_SIZE (1 << 16)
@@ -21,81 +41,128 @@ static mpage ***page_maps1;
 #define PAGEMAP64_LEVEL1_BITS(p) (((uintptr_t)(p)) >> 48)
 #define PAGEMAP64_LEVEL2_BITS(p) ((((uintptr_t)(p)) >> 32) & ((PAGEMAP64_LEVEL2_SIZE) - 1))
 #define PAGEMAP64_LEVEL3_BITS(p) ((((uintptr_t)(p)) >> LOG_APAGE_SIZE) & ((PAGEMAP64_LEVEL3_SIZE) - 1))
+#define PAGEMAP_SHARD(p) ((((uintptr_t)(p)) >> LOG_APAGE_SIZE) % PAGEMAP_SHARDS)
 
-void pagemap_modify(void *p, int mapped) {
-  uintptr_t pos;
-  mpage **page_maps2;
-  mpage *page_maps3;
-  mpage *page;
+static void init_shards(void) {
+  int i;
 
-  if (!page_maps1) {
-    page_maps1 = calloc(PAGEMAP64_LEVEL1_SIZE, sizeof(mpage **));
-  }
+  for (i = 0; i < PAGEMAP_SHARDS; i++)
+    pthread_mutex_init(&shards[i].lock, NULL);
+}
+
+/* Return the table stored in *slot, installing a zeroed one of n
+   entries first if there is none. Racing installers agree on the
+   table that won the compare-and-swap. */
+static void *get_level(_Atomic(void *) *slot, size_t n, size_t entry_size) {
+  void *table, *expected = NULL;
+
+  table = atomic_load_explicit(slot, memory_order_acquire);
+  if (table)
+    return table;
 
-  pos = PAGEMAP64_LEVEL1_BITS(p);
-  page_maps2 = page_maps1[pos];
-  if (!page_maps2) {
-    page_maps2 = calloc(PAGEMAP64_LEVEL2_SIZE, sizeof(mpage *));
-    page_maps1[pos] = page_maps2;
+  table = calloc(n, entry_size);
+  if (!table) {
+    fprintf(stderr, "internal error: out of memory for page map\n");
+    abort();
   }
-  
-  pos = PAGEMAP64_LEVEL2_BITS(p);
-  page_maps3 = page_maps2[pos];
-  if (!page_maps3) {
-    page_maps3 = calloc(PAGEMAP64_LEVEL3_SIZE, sizeof(mpage));
-    page_maps2[pos] = page_maps3;
+  if (!atomic_compare_exchange_strong_explicit(slot, &expected, table,
+                                               memory_order_acq_rel,
+                                               memory_order_acquire)) {
+    free(table);
+    table = expected;
   }
+  return table;
+}
 
-  page = &page_maps3[PAGEMAP64_LEVEL3_BITS(p)];
+static mpage *find_page(void *p, int create) {
+  mpage_ptr *page_maps2;
+  mpage *page_maps3;
 
+  if (create) {
+    level2_ptr *l1 = get_level((_Atomic(void *) *)&page_maps1,
+                               PAGEMAP64_LEVEL1_SIZE, sizeof(level2_ptr));
+    mpage_ptr *l2 = get_level((_Atomic(void *) *)&l1[PAGEMAP64_LEVEL1_BITS(p)],
+                              PAGEMAP64_LEVEL2_SIZE, sizeof(mpage_ptr));
+    page_maps3 = get_level((_Atomic(void *) *)&l2[PAGEMAP64_LEVEL2_BITS(p)],
+                           PAGEMAP64_LEVEL3_SIZE, sizeof(mpage));
+  } else {
+    level2_ptr *l1 = atomic_load_explicit(&page_maps1, memory_order_acquire);
+    if (!l1) return NULL;
+    page_maps2 = atomic_load_explicit(&l1[PAGEMAP64_LEVEL1_BITS(p)],
+                                      memory_order_acquire);
+    if (!page_maps2) return NULL;
+    page_maps3 = atomic_load_explicit(&page_maps2[PAGEMAP64_LEVEL2_BITS(p)],
+                                      memory_order_acquire);
+    if (!page_maps3) return NULL;
+  }
+
+  return &page_maps3[PAGEMAP64_LEVEL3_BITS(p)];
+}
+
+void pagemap_modify(void *p, int mapped) {
+  mpage *page;
+  shard *s;
+
+  pthread_once(&shards_once, init_shards);
+
+  page = find_page(p, 1);
+  s = &shards[PAGEMAP_SHARD(p)];
+
+  pthread_mutex_lock(&s->lock);
   if (mapped) {
-    if (page->addr) {
+    if (atomic_load_explicit(&page->addr, memory_order_relaxed)) {
       fprintf(stderr, "internal error: page is already mapped\n");
       abort();
     }
-    if (page == all_mapped_pages)
+    if (page == s->all_mapped_pages)
       abort();
-    page->addr = p;
     page->prev = NULL;
-    page->next = all_mapped_pages;
-    if (all_mapped_pages)
-      all_mapped_pages->prev = page;
-    all_mapped_pages = page;
+    page->next = s->all_mapped_pages;
+    if (s->all_mapped_pages)
+      s->all_mapped_pages->prev = page;
+    s->all_mapped_pages = page;
+    atomic_store_explicit(&page->addr, p, memory_order_release);
   } else {
-    if (!page->addr) {
+    if (!atomic_load_explicit(&page->addr, memory_order_relaxed)) {
       fprintf(stderr, "internal error: not currently mapped\n");
       abort();
     }
-    page->addr = NULL;
+    atomic_store_explicit(&page->addr, NULL, memory_order_release);
     if (page->prev)
       page->prev->next = page->next;
     else
-      all_mapped_pages = page->next;
+      s->all_mapped_pages = page->next;
     if (page->next)
       page->next->prev = page->prev;
   }
+  pthread_mutex_unlock(&s->lock);
 }
 
 int pagemap_is_mapped(void *p) {
-  mpage **page_maps2;
-  mpage *page_maps3;
+  mpage *page = find_page(p, 0);
 
-  if (!page_maps1) return 0;
-  page_maps2 = page_maps1[PAGEMAP64_LEVEL1_BITS(p)];
-  if (!page_maps2) return 0;
-  page_maps3 = page_maps2[PAGEMAP64_LEVEL2_BITS(p)];
-  if (!page_maps3) return 0;
-  return !!page_maps3[PAGEMAP64_LEVEL3_BITS(p)].addr;
+  if (!page) return 0;
+  return !!atomic_load_explicit(&page->addr, memory_order_acquire);
 }
 
 void pagemap_for_each(page_callback f) {
   mpage *p, *next;
-  p = all_mapped_pages;
-  while (p) {
-    next = p->next;
-    f(p->addr);
-    pagemap_modify(p->addr, 0);
-    p = next;
+  shard *s;
+  int i;
+
+  pthread_once(&shards_once, init_shards);
+
+  for (i = 0; i < PAGEMAP_SHARDS; i++) {
+    s = &shards[i];
+    pthread_mutex_lock(&s->lock);
+    p = s->all_mapped_pages;
+    while (p) {
+      next = p->next;
+      f(atomic_load_explicit(&p->addr, memory_order_relaxed));
+      atomic_store_explicit(&p->addr, NULL, memory_order_release);
+      p = next;
+    }
+    s->all_mapped_pages = NULL;
+    pthread_mutex_unlock(&s->lock);
   }
-  all_mapped_pages = NULL;
 }
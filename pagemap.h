@@ -1,6 +1,9 @@
 
 typedef void (*page_callback)(void *addr);
 
+/* pagemap_modify and pagemap_is_mapped are safe to call concurrently;
+   pagemap_for_each must not race with pagemap_modify on the same page */
+
 void pagemap_modify(void *addr, int mapped);
 int pagemap_is_mapped(void *addr);
 void pagemap_for_each(page_callback f);
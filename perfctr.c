@@ -0,0 +1,168 @@
+/*
+ * perfctr.c - hardware performance counters via perf_event_open
+ *
+ * The events are opened as one group led by the first event that
+ * opens, so that the kernel schedules them onto the PMU together. An
+ * event that can't join the group (e.g. the PMU runs out of
+ * registers) is opened on its own, and its count is scaled by the
+ * fraction of the time it was actually counting.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+char *perf_event_names[PERF_NEVENTS] = {
+    "instructions", "cycles", "l1d_misses", "llc_misses",
+    "dtlb_misses", "branch_misses"
+};
+
+#define CACHE_EVENT(cache) ((cache) \
+			    | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+			    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    uint32_t type;
+    uint64_t config;
+} events[PERF_NEVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PERF_NEVENTS];
+static pid_t opened_by = 0;       /* process the counters belong to */
+static int navailable = 0;
+static char why[256] = "";
+
+/*
+ * open_event - Open event i, in the group led by group_fd if it is
+ *     not -1
+ */
+static int open_event(int i, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+	| PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/*
+ * perf_open - Open the counters for this process, once
+ */
+static void perf_open(void)
+{
+    int i, leader = -1;
+    FILE *f;
+    int paranoid;
+
+    if (opened_by == getpid())
+	return;
+    if (opened_by != 0) {
+	/* A forked worker: the inherited counters watch the parent */
+	for (i = 0; i < PERF_NEVENTS; i++)
+	    if (fds[i] >= 0)
+		close(fds[i]);
+    }
+    opened_by = getpid();
+    navailable = 0;
+
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	fds[i] = open_event(i, leader);
+	if (fds[i] < 0 && leader >= 0)
+	    fds[i] = open_event(i, -1);
+	if (fds[i] < 0) {
+	    if (why[0] == '\0')
+		snprintf(why, sizeof(why), "%s", strerror(errno));
+	    continue;
+	}
+	if (leader < 0)
+	    leader = fds[i];
+	navailable++;
+    }
+
+    if (navailable == 0 && (f = fopen("/proc/sys/kernel/perf_event_paranoid",
+				      "r")) != NULL) {
+	if (fscanf(f, "%d", &paranoid) == 1)
+	    snprintf(why + strlen(why), sizeof(why) - strlen(why),
+		     " (perf_event_paranoid is %d)", paranoid);
+	fclose(f);
+    }
+}
+
+/*
+ * perf_available - Return how many of the events can be counted
+ */
+int perf_available(void)
+{
+    perf_open();
+    return navailable;
+}
+
+/*
+ * perf_why_unavailable - Return why the first event that could not be
+ *     counted failed to open
+ */
+char *perf_why_unavailable(void)
+{
+    return why;
+}
+
+/*
+ * perf_start - Reset the counters and start counting
+ */
+void perf_start(void)
+{
+    int i;
+
+    perf_open();
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+}
+
+/*
+ * perf_stop - Stop counting and read the counts since perf_start
+ */
+void perf_stop(perf_counts_t *counts)
+{
+    uint64_t value[3]; /* count, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PERF_NEVENTS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (i = 0; i < PERF_NEVENTS; i++) {
+	counts->valid[i] = 0;
+	counts->count[i] = 0;
+	if (fds[i] < 0 || read(fds[i], value, sizeof(value)) != sizeof(value)
+	    || value[2] == 0)
+	    continue;
+	counts->valid[i] = 1;
+	counts->count[i] = (double)value[0];
+	if (value[2] < value[1])    /* multiplexed with other events */
+	    counts->count[i] *= (double)value[1] / value[2];
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/*
+ * perfctr.h - hardware performance counters via perf_event_open
+ *
+ * The counters count user-mode events of the calling process only, so
+ * each -j worker opens its own. Any counter the kernel or the CPU
+ * won't give us (in containers, perf_event_paranoid often blocks them
+ * all) is just left out of the results.
+ */
+
+/* The events counted, in the order of perf_counts_t.count */
+#define PERF_INSTRUCTIONS  0
+#define PERF_CYCLES        1
+#define PERF_L1D_MISSES    2
+#define PERF_LLC_MISSES    3
+#define PERF_DTLB_MISSES   4
+#define PERF_BRANCH_MISSES 5
+#define PERF_NEVENTS       6
+
+typedef struct {
+    int valid[PERF_NEVENTS];     /* was the event counted? */
+    double count[PERF_NEVENTS];  /* events, scaled up if multiplexed */
+} perf_counts_t;
+
+extern char *perf_event_names[PERF_NEVENTS];
+
+int perf_available(void);
+char *perf_why_unavailable(void);
+void perf_start(void);
+void perf_stop(perf_counts_t *counts);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,393 @@
+/*
+ * profile.c - statistics of a trace's requests (-A)
+ *
+ * Sizes and lifetimes go into histograms with one bucket per power of
+ * two. The live curve is sampled at PROF_POINTS evenly spaced
+ * requests, so its length doesn't grow with the trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "profile.h"
+#include "trace.h"
+
+#define PROF_BUCKETS 65        /* power-of-two buckets of a 64-bit value */
+#define PROF_CLASS   16        /* width of a size class */
+#define PROF_CLASSES 64        /* classes shown; larger sizes are lumped */
+#define PROF_TOP     16        /* most common classes printed */
+#define PROF_POINTS  20        /* samples of the live curve */
+#define PROF_BAR     40        /* width of a histogram bar */
+
+/* Realloc growth, as new size / old size */
+static char *growth_names[] = {
+    "< 0.5", "0.5-1", "same", "1-1.25", "1.25-1.5", "1.5-2", "2", "2-4", ">= 4"
+};
+#define PROF_GROWTH (sizeof(growth_names) / sizeof(char *))
+
+/* A live block */
+typedef struct {
+    uint64_t key;              /* index + 1, or 0 if the slot is empty */
+    uint64_t born;             /* request that allocated it */
+    uint64_t size;
+} slot_t;
+
+typedef struct {
+    uint64_t op;
+    double bytes;
+    uint64_t blocks;
+} point_t;
+
+struct prof {
+    uint64_t num_ops;          /* requests the trace says it has */
+    uint64_t op;               /* requests seen so far */
+    uint64_t nalloc, nrealloc, nfree, unknown;
+
+    uint64_t size_hist[PROF_BUCKETS];
+    uint64_t class_hist[PROF_CLASSES + 1];
+    uint64_t life_hist[PROF_BUCKETS];
+    uint64_t growth_hist[PROF_GROWTH];
+
+    double live_bytes, peak_bytes;
+    uint64_t live_blocks, peak_blocks;
+    uint64_t peak_bytes_op, peak_blocks_op;
+    point_t curve[PROF_POINTS + 1];
+    int npoints;
+
+    int after_free;            /* was the previous request a free? */
+    int have_freed;
+    uint64_t freed_size;       /* size of the last block freed */
+    uint64_t allocs_after_free, same_after_free, same_as_freed;
+
+    slot_t *slots;             /* the live blocks, by index */
+    uint64_t mask;
+};
+
+/*
+ * prof_error - Report a Unix-style error and exit
+ */
+static void prof_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * log2_bucket - Return the power-of-two bucket of x: 0 for 0, else
+ *     k + 1 for x in [2^k, 2^(k+1))
+ */
+static int log2_bucket(uint64_t x)
+{
+    return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+/*
+ * Live block table, with linear probing
+ */
+static uint64_t slot_hash(prof_t *p, uint64_t key)
+{
+    return (key * 0x9e3779b97f4a7c15ULL >> 17) & p->mask;
+}
+
+static slot_t *slot_find(prof_t *p, uint64_t index)
+{
+    uint64_t i, key = index + 1;
+
+    for (i = slot_hash(p, key); p->slots[i].key != 0; i = (i + 1) & p->mask)
+	if (p->slots[i].key == key)
+	    return &p->slots[i];
+    return NULL;
+}
+
+static void slot_grow(prof_t *p);
+
+static slot_t *slot_add(prof_t *p, uint64_t index)
+{
+    uint64_t i, key = index + 1;
+
+    if (2 * (p->live_blocks + 1) > p->mask + 1)
+	slot_grow(p);
+    for (i = slot_hash(p, key); p->slots[i].key != 0; i = (i + 1) & p->mask)
+	;
+    p->slots[i].key = key;
+    return &p->slots[i];
+}
+
+static void slot_grow(prof_t *p)
+{
+    slot_t *old = p->slots, *s;
+    uint64_t i, n = p->mask + 1;
+
+    if ((p->slots = calloc(2 * n, sizeof(slot_t))) == NULL)
+	prof_error("calloc failed in slot_grow");
+    p->mask = 2 * n - 1;
+    for (i = 0; i < n; i++)
+	if (old[i].key != 0) {
+	    for (s = &p->slots[slot_hash(p, old[i].key)]; s->key != 0;
+		 s = &p->slots[(s - p->slots + 1) & p->mask])
+		;
+	    *s = old[i];
+	}
+    free(old);
+}
+
+/* Remove a slot, shifting back the entries of its probe run */
+static void slot_remove(prof_t *p, slot_t *s)
+{
+    uint64_t hole = s - p->slots, i = hole, home;
+
+    for (;;) {
+	i = (i + 1) & p->mask;
+	if (p->slots[i].key == 0)
+	    break;
+	home = slot_hash(p, p->slots[i].key);
+	/* Move it if its home is not cyclically within (hole, i] */
+	if (((i - home) & p->mask) >= ((i - hole) & p->mask)) {
+	    p->slots[hole] = p->slots[i];
+	    hole = i;
+	}
+    }
+    p->slots[hole].key = 0;
+}
+
+/*
+ * prof_new - Start a profile of a trace of num_ops requests
+ */
+prof_t *prof_new(uint64_t num_ops)
+{
+    prof_t *p;
+
+    if ((p = calloc(1, sizeof(prof_t))) == NULL
+	|| (p->slots = calloc(1024, sizeof(slot_t))) == NULL)
+	prof_error("calloc failed in prof_new");
+    p->mask = 1023;
+    p->num_ops = num_ops;
+    return p;
+}
+
+/*
+ * add_size - Count the size of an alloc or realloc
+ */
+static void add_size(prof_t *p, uint64_t size)
+{
+    uint64_t c = (size + PROF_CLASS - 1) / PROF_CLASS;
+
+    p->size_hist[log2_bucket(size)]++;
+    p->class_hist[(c < PROF_CLASSES) ? c : PROF_CLASSES]++;
+}
+
+/*
+ * prof_op - Count request p->op, an ALLOC, FREE or REALLOC of the
+ *     block with this index
+ */
+void prof_op(prof_t *p, int type, uint64_t index, uint64_t size)
+{
+    slot_t *s;
+    double r;
+    int g;
+
+    /* Sample the live curve before the request */
+    while (p->npoints <= PROF_POINTS && p->num_ops > 0
+	   && p->op >= p->npoints * p->num_ops / PROF_POINTS) {
+	p->curve[p->npoints].op = p->op;
+	p->curve[p->npoints].bytes = p->live_bytes;
+	p->curve[p->npoints].blocks = p->live_blocks;
+	p->npoints++;
+    }
+
+    switch (type) {
+    case ALLOC:
+	p->nalloc++;
+	add_size(p, size);
+	if (p->after_free) {
+	    p->allocs_after_free++;
+	    p->same_after_free += (size == p->freed_size);
+	}
+	p->same_as_freed += (p->have_freed && size == p->freed_size);
+	s = slot_add(p, index);
+	s->born = p->op;
+	s->size = size;
+	p->live_bytes += size;
+	p->live_blocks++;
+	break;
+
+    case REALLOC:
+	p->nrealloc++;
+	add_size(p, size);
+	if ((s = slot_find(p, index)) == NULL) {
+	    p->unknown++;
+	    break;
+	}
+	r = s->size ? (double)size / s->size : 4;
+	g = (r < 0.5) ? 0 : (r < 1) ? 1 : (r == 1) ? 2 : (r <= 1.25) ? 3
+	    : (r <= 1.5) ? 4 : (r < 2) ? 5 : (r == 2) ? 6 : (r < 4) ? 7 : 8;
+	p->growth_hist[g]++;
+	p->live_bytes += (double)size - s->size;
+	s->size = size;
+	break;
+
+    case FREE:
+	p->nfree++;
+	if ((s = slot_find(p, index)) == NULL) {
+	    p->unknown++;
+	    break;
+	}
+	p->life_hist[log2_bucket(p->op - s->born)]++;
+	p->live_bytes -= s->size;
+	p->live_blocks--;
+	p->freed_size = s->size;
+	p->have_freed = 1;
+	slot_remove(p, s);
+	break;
+    }
+    p->after_free = (type == FREE);
+
+    if (p->live_bytes > p->peak_bytes) {
+	p->peak_bytes = p->live_bytes;
+	p->peak_bytes_op = p->op;
+    }
+    if (p->live_blocks > p->peak_blocks) {
+	p->peak_blocks = p->live_blocks;
+	p->peak_blocks_op = p->op;
+    }
+    p->op++;
+}
+
+/*
+ * print_bar - Print a bar for count out of total
+ */
+static void print_bar(uint64_t count, uint64_t total)
+{
+    int n = total ? (int)((double)count * PROF_BAR / total + 0.5) : 0;
+
+    printf(" ");
+    while (n-- > 0)
+	printf("#");
+    printf("\n");
+}
+
+/*
+ * print_log2 - Print a power-of-two histogram
+ */
+static void print_log2(uint64_t *hist, char *unit)
+{
+    uint64_t total = 0, cum = 0;
+    int b, lo = PROF_BUCKETS, hi = -1;
+
+    for (b = 0; b < PROF_BUCKETS; b++)
+	if (hist[b]) {
+	    total += hist[b];
+	    lo = (b < lo) ? b : lo;
+	    hi = b;
+	}
+    if (total == 0) {
+	printf("  (none)\n");
+	return;
+    }
+    printf("  %22s %12s %6s %6s\n", unit, "count", "%", "cum%");
+    for (b = lo; b <= hi; b++) {
+	cum += hist[b];
+	if (b == 0)
+	    printf("  %22s", "0");
+	else
+	    printf("  %10llu - %9llu", 1ULL << (b - 1),
+		   (b < 64) ? (1ULL << b) - 1 : ~0ULL);
+	printf(" %12llu %6.1f %6.1f", (unsigned long long)hist[b],
+	       100.0 * hist[b] / total, 100.0 * cum / total);
+	print_bar(hist[b], total);
+    }
+}
+
+/*
+ * prof_print - Print the profile
+ */
+void prof_print(prof_t *p)
+{
+    int i, j, top[PROF_TOP], ntop = 0;
+    uint64_t total, cum;
+
+    printf("requests %llu: %llu allocs, %llu reallocs, %llu frees",
+	   (unsigned long long)p->op, (unsigned long long)p->nalloc,
+	   (unsigned long long)p->nrealloc, (unsigned long long)p->nfree);
+    if (p->unknown)
+	printf(", %llu on unknown blocks", (unsigned long long)p->unknown);
+    printf("\n");
+
+    printf("\nRequest sizes (allocs and reallocs):\n");
+    print_log2(p->size_hist, "bytes");
+
+    /* The most common 16-byte classes, most common first */
+    total = p->nalloc + p->nrealloc;
+    for (i = 0; i <= PROF_CLASSES; i++) {
+	if (p->class_hist[i] == 0)
+	    continue;
+	for (j = ntop; j > 0 && p->class_hist[top[j-1]] < p->class_hist[i]; j--)
+	    if (j < PROF_TOP)
+		top[j] = top[j-1];
+	if (j < PROF_TOP) {
+	    top[j] = i;
+	    ntop += (ntop < PROF_TOP);
+	}
+    }
+    printf("\nMost common %d-byte size classes:\n", PROF_CLASS);
+    printf("  %22s %12s %6s %6s\n", "bytes", "count", "%", "cum%");
+    for (i = 0, cum = 0; i < ntop; i++) {
+	cum += p->class_hist[top[i]];
+	if (top[i] == PROF_CLASSES)
+	    printf("  %12s %9d", ">", PROF_CLASSES * PROF_CLASS);
+	else if (top[i] == 0)
+	    printf("  %22s", "0");
+	else
+	    printf("  %10d - %9d", (top[i] - 1) * PROF_CLASS + 1,
+		   top[i] * PROF_CLASS);
+	printf(" %12llu %6.1f %6.1f", (unsigned long long)p->class_hist[top[i]],
+	       100.0 * p->class_hist[top[i]] / total, 100.0 * cum / total);
+	print_bar(p->class_hist[top[i]], total);
+    }
+
+    printf("\nLifetimes of freed blocks:\n");
+    print_log2(p->life_hist, "requests");
+    printf("  never freed: %llu\n", (unsigned long long)p->live_blocks);
+
+    printf("\nLive blocks over the trace:\n");
+    printf("  %12s %14s %10s\n", "request", "bytes", "blocks");
+    for (i = 0; i < p->npoints; i++)
+	printf("  %12llu %14.0f %10llu\n", (unsigned long long)p->curve[i].op,
+	       p->curve[i].bytes, (unsigned long long)p->curve[i].blocks);
+    printf("  %12llu %14.0f %10llu\n", (unsigned long long)p->op,
+	   p->live_bytes, (unsigned long long)p->live_blocks);
+    printf("  peak bytes %.0f at request %llu, peak blocks %llu at request %llu\n",
+	   p->peak_bytes, (unsigned long long)p->peak_bytes_op,
+	   (unsigned long long)p->peak_blocks, (unsigned long long)p->peak_blocks_op);
+
+    printf("\nRealloc growth (new size / old size):\n");
+    for (i = 0, total = 0; i < PROF_GROWTH; i++)
+	total += p->growth_hist[i];
+    if (total == 0)
+	printf("  (none)\n");
+    for (i = 0; total && i < PROF_GROWTH; i++) {
+	printf("  %10s %12llu %6.1f", growth_names[i],
+	       (unsigned long long)p->growth_hist[i],
+	       100.0 * p->growth_hist[i] / total);
+	print_bar(p->growth_hist[i], total);
+    }
+
+    printf("\nSize reuse:\n");
+    printf("  allocs right after a free: %llu, of the freed size: %llu (%.1f%%)\n",
+	   (unsigned long long)p->allocs_after_free,
+	   (unsigned long long)p->same_after_free,
+	   p->allocs_after_free ? 100.0 * p->same_after_free / p->allocs_after_free : 0);
+    printf("  allocs of the last freed size: %llu of %llu (%.1f%%)\n",
+	   (unsigned long long)p->same_as_freed, (unsigned long long)p->nalloc,
+	   p->nalloc ? 100.0 * p->same_as_freed / p->nalloc : 0);
+}
+
+/*
+ * prof_free - Free a profile
+ */
+void prof_free(prof_t *p)
+{
+    free(p->slots);
+    free(p);
+}
@@ -0,0 +1,25 @@
+#ifndef __PROFILE_H_
+#define __PROFILE_H_
+
+/*
+ * profile.h - statistics of a trace's requests (-A)
+ *
+ * The requests are fed in order with prof_op, so a trace is profiled
+ * in one pass without holding it in memory; only the live blocks are
+ * kept, in a hash table by id. prof_print reports
+ *   - request sizes, by power of two and by 16-byte class
+ *   - block lifetimes, in requests from alloc to free
+ *   - the live bytes and blocks over the trace, and their peaks
+ *   - how much reallocs grow or shrink their blocks
+ *   - how often an alloc asks for the size that was just freed
+ */
+#include <stdint.h>
+
+typedef struct prof prof_t;
+
+prof_t *prof_new(uint64_t num_ops);
+void prof_op(prof_t *p, int type, uint64_t index, uint64_t size);
+void prof_print(prof_t *p);
+void prof_free(prof_t *p);
+
+#endif /* __PROFILE_H_ */
@@ -0,0 +1,293 @@
+/*
+ * replay.c - multithreaded trace replay
+ *
+ * See replay.h for how requests are assigned to workers. Each run
+ * starts the workers together at a barrier, so that the time each one
+ * reports covers only its own requests. The time of a run is from the
+ * first worker leaving the barrier to the last one finishing, which
+ * leaves out the allocator's init and the thread creation and joining
+ * that fsecs also times.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "replay.h"
+
+/* Flags of a request */
+#define WAIT    1  /* the previous request on its id ran on another worker */
+#define PUBLISH 2  /* the next request on its id runs on another worker */
+
+typedef struct {
+    replay_t *r;
+    int *ops;           /* indices of this worker's requests, in order */
+    int nops;
+    char **blocks;      /* where the worker keeps each id's block */
+    double start, end;  /* when it started and finished the last run */
+    double secs;        /* time of its requests in the fastest run */
+    pthread_t thread;
+} __attribute__((aligned(64))) worker_t;
+
+struct replay {
+    trace_t *trace;
+    int nthreads;
+    int copies;         /* each worker replays a whole copy of the trace */
+    allocator_t *alloc; /* allocator replayed on */
+    worker_t *workers;
+    int *seqno;         /* per request: number of earlier requests on its id */
+    unsigned char *flags;
+    atomic_int *seq;    /* per id: requests on it that have completed */
+    pthread_barrier_t start;
+    double secs;        /* time of the fastest run, 0 before any */
+};
+
+/* Serializes the calls into an allocator that is not thread-safe */
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * replay_error - Report an error and exit
+ */
+static void replay_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * replay_prepare - Plan a replay of trace by nthreads workers on the
+ *     allocator a
+ */
+replay_t *replay_prepare(trace_t *trace, int nthreads, allocator_t *a)
+{
+    replay_t *r;
+    worker_t *w;
+    int i, id, *count, *last;
+
+    if (nthreads > REPLAY_MAX_THREADS)
+	nthreads = REPLAY_MAX_THREADS;
+    if ((r = calloc(1, sizeof(replay_t))) == NULL
+	|| (r->workers = aligned_alloc(64, nthreads * sizeof(worker_t))) == NULL
+	|| (r->seqno = malloc(trace->num_ops * sizeof(int))) == NULL
+	|| (r->flags = calloc(trace->num_ops, 1)) == NULL
+	|| (r->seq = malloc(trace->num_ids * sizeof(atomic_int))) == NULL)
+	replay_error("malloc failed in replay_prepare");
+    memset(r->workers, 0, nthreads * sizeof(worker_t));
+    r->trace = trace;
+    r->nthreads = nthreads;
+    r->copies = trace->num_threads == 1;
+    r->alloc = a;
+
+    if (r->copies) {
+	/* Every worker runs all the requests on its own blocks */
+	for (i = 0; i < nthreads; i++) {
+	    w = &r->workers[i];
+	    if ((w->ops = malloc(trace->num_ops * sizeof(int))) == NULL
+		|| (w->blocks = malloc(trace->num_ids * sizeof(char *))) == NULL)
+		replay_error("malloc failed in replay_prepare");
+	    for (w->nops = 0; w->nops < trace->num_ops; w->nops++)
+		w->ops[w->nops] = w->nops;
+	}
+	return r;
+    }
+
+    /* Split the requests by thread, and find the cross-worker handoffs */
+    if ((count = calloc(trace->num_ids, sizeof(int))) == NULL
+	|| (last = malloc(trace->num_ids * sizeof(int))) == NULL)
+	replay_error("malloc failed in replay_prepare");
+    for (i = 0; i < trace->num_ids; i++)
+	last[i] = -1;
+    for (i = 0; i < nthreads; i++) {
+	if ((r->workers[i].ops = malloc(trace->num_ops * sizeof(int))) == NULL)
+	    replay_error("malloc failed in replay_prepare");
+	r->workers[i].blocks = trace->blocks;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+	id = trace->ops[i].index;
+	w = &r->workers[trace->ops[i].tid % nthreads];
+	w->ops[w->nops++] = i;
+	r->seqno[i] = count[id]++;
+	if (last[id] >= 0
+	    && trace->ops[last[id]].tid % nthreads != trace->ops[i].tid % nthreads) {
+	    r->flags[i] |= WAIT;
+	    r->flags[last[id]] |= PUBLISH;
+	}
+	last[id] = i;
+    }
+    free(count);
+    free(last);
+    return r;
+}
+
+/*
+ * now_secs - Return the monotonic clock in seconds
+ */
+static double now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * replay_worker - Run one worker's requests
+ */
+static void *replay_worker(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    replay_t *r = w->r;
+    traceop_t *op;
+    allocator_t *a = r->alloc;
+    int j, i, lock = !a->thread_safe;
+    char *p;
+
+    pthread_barrier_wait(&r->start);
+    w->start = now_secs();
+
+    for (j = 0; j < w->nops; j++) {
+	i = w->ops[j];
+	op = &r->trace->ops[i];
+
+	/* Wait for the block to be handed over by another worker */
+	if (r->flags[i] & WAIT)
+	    while (atomic_load_explicit(&r->seq[op->index],
+					memory_order_acquire) != r->seqno[i])
+		sched_yield();
+
+	if (lock)
+	    pthread_mutex_lock(&alloc_lock);
+	switch (op->type) {
+	case ALLOC:
+	    p = a->malloc(op->size);
+	    if (p == NULL)
+		replay_error("malloc failed in replay_worker");
+	    w->blocks[op->index] = p;
+	    break;
+
+	case REALLOC:
+	    p = w->blocks[op->index];
+	    p = a->realloc(p, op->size);
+	    if (p == NULL)
+		replay_error("realloc failed in replay_worker");
+	    w->blocks[op->index] = p;
+	    break;
+
+	case FREE:
+	    a->free(w->blocks[op->index]);
+	    break;
+	}
+	if (lock)
+	    pthread_mutex_unlock(&alloc_lock);
+
+	if (r->flags[i] & PUBLISH)
+	    atomic_store_explicit(&r->seq[op->index], r->seqno[i] + 1,
+				  memory_order_release);
+    }
+
+    w->end = now_secs();
+    return NULL;
+}
+
+/*
+ * replay_run - Replay the trace once with all workers. This is the
+ *     function that fsecs times.
+ */
+void replay_run(void *arg)
+{
+    replay_t *r = (replay_t *)arg;
+    double start, end;
+    int i;
+
+    for (i = 0; i < r->trace->num_ids; i++)
+	atomic_init(&r->seq[i], 0);
+    if (r->alloc->init() < 0) {
+	printf("%s init failed in replay_run\n", r->alloc->name);
+	exit(1);
+    }
+
+    pthread_barrier_init(&r->start, NULL, r->nthreads);
+    for (i = 0; i < r->nthreads; i++) {
+	r->workers[i].r = r;
+	if ((errno = pthread_create(&r->workers[i].thread, NULL,
+				    replay_worker, &r->workers[i])) != 0)
+	    replay_error("pthread_create failed in replay_run");
+    }
+    for (i = 0; i < r->nthreads; i++)
+	pthread_join(r->workers[i].thread, NULL);
+    pthread_barrier_destroy(&r->start);
+
+    /* Keep the fastest run */
+    start = r->workers[0].start;
+    end = r->workers[0].end;
+    for (i = 1; i < r->nthreads; i++) {
+	if (r->workers[i].start < start)
+	    start = r->workers[i].start;
+	if (r->workers[i].end > end)
+	    end = r->workers[i].end;
+    }
+    if (r->secs == 0 || end - start < r->secs) {
+	r->secs = end - start;
+	for (i = 0; i < r->nthreads; i++)
+	    r->workers[i].secs = r->workers[i].end - r->workers[i].start;
+    }
+}
+
+/*
+ * replay_secs - Return the time of the fastest run, from the barrier
+ *     to the last worker's finish
+ */
+double replay_secs(replay_t *r)
+{
+    return r->secs;
+}
+
+/*
+ * replay_nthreads - Return the number of workers
+ */
+int replay_nthreads(replay_t *r)
+{
+    return r->nthreads;
+}
+
+/*
+ * replay_ops - Return the number of requests in one run
+ */
+double replay_ops(replay_t *r)
+{
+    return r->copies ? (double)r->trace->num_ops * r->nthreads
+	: r->trace->num_ops;
+}
+
+/*
+ * replay_thread_result - Get worker k's requests and its time in the
+ *     fastest run
+ */
+void replay_thread_result(replay_t *r, int k, double *ops, double *secs)
+{
+    *ops = r->workers[k].nops;
+    *secs = r->workers[k].secs;
+}
+
+/*
+ * replay_free - Free a replay planned by replay_prepare
+ */
+void replay_free(replay_t *r)
+{
+    int i;
+
+    for (i = 0; i < r->nthreads; i++) {
+	free(r->workers[i].ops);
+	if (r->copies)
+	    free(r->workers[i].blocks);
+    }
+    free(r->workers);
+    free(r->seqno);
+    free(r->flags);
+    free(r->seq);
+    free(r);
+}
@@ -0,0 +1,33 @@
+#ifndef __REPLAY_H_
+#define __REPLAY_H_
+
+/*
+ * replay.h - multithreaded trace replay
+ *
+ * A trace is replayed by n worker threads. The requests of trace
+ * thread t run on worker t % n, in trace order. A trace with a single
+ * thread is instead replayed in full by each of the n workers, every
+ * one on its own copy of the blocks, to show how the allocator scales
+ * with independent threads.
+ *
+ * A block that one worker allocates and another frees or reallocs is
+ * handed off through a per-id sequence number: each request on an id
+ * waits until the id's previous request, if it ran on another worker,
+ * has published its completion.
+ */
+#include "trace.h"
+#include "alloc.h"
+
+#define REPLAY_MAX_THREADS 64
+
+typedef struct replay replay_t;
+
+replay_t *replay_prepare(trace_t *trace, int nthreads, allocator_t *a);
+void replay_run(void *r);
+double replay_secs(replay_t *r);
+int replay_nthreads(replay_t *r);
+double replay_ops(replay_t *r);
+void replay_thread_result(replay_t *r, int k, double *ops, double *secs);
+void replay_free(replay_t *r);
+
+#endif /* __REPLAY_H_ */
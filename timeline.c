@@ -0,0 +1,153 @@
+/*
+ * timeline.c - fragmentation over the course of a trace
+ *
+ * See timeline.h for how the samples are downsampled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "timeline.h"
+
+#define MAXLINE 1024 /* max string size */
+
+extern int verbose; /* -v option in mdriver.c */
+
+/*
+ * tl_error - Report a Unix-style error and exit
+ */
+static void tl_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * tl_init - Start an empty timeline of at most max points
+ */
+void tl_init(timeline_t *tl, int max)
+{
+    max &= ~1;           /* tl_halve merges the points in pairs */
+    if (max < 2)
+	max = 2;
+    if ((tl->points = malloc(max * sizeof(tl_point_t))) == NULL)
+	tl_error("malloc failed in tl_init");
+    tl->n = 0;
+    tl->max = max;
+    tl->stride = 1;
+    tl->covered = 0;
+}
+
+/*
+ * tl_halve - Merge each pair of neighbouring points into one, keeping
+ *     the sample with the most free bytes, and double the stride
+ */
+static void tl_halve(timeline_t *tl)
+{
+    tl_point_t *a, *b;
+    int i;
+
+    for (i = 0; i < tl->n / 2; i++) {
+	a = &tl->points[2*i];
+	b = &tl->points[2*i + 1];
+	tl->points[i] = b->free >= a->free ? *b : *a;
+    }
+    tl->n /= 2;
+    tl->stride *= 2;
+}
+
+/*
+ * tl_add - Sample the heap after request op
+ */
+void tl_add(timeline_t *tl, uint64_t op, size_t live, size_t heap,
+	    long chunks)
+{
+    tl_point_t *p;
+    uint64_t free = heap > live ? heap - live : 0;
+
+    /* Start a new point once the last one covers a whole stride */
+    if (tl->n == 0 || tl->covered == tl->stride) {
+	if (tl->n == tl->max)
+	    tl_halve(tl);
+	tl->n++;
+	tl->covered = 0;
+	tl->points[tl->n - 1].free = 0;
+	tl->points[tl->n - 1].op = UINT64_MAX;
+    }
+
+    p = &tl->points[tl->n - 1];
+    tl->covered++;
+    if (p->op == UINT64_MAX || free >= p->free) {
+	p->op = op;
+	p->live = live;
+	p->heap = heap;
+	p->free = free;
+	p->chunks = chunks;
+    }
+}
+
+/*
+ * tl_write - Write the timeline of trace tracenum next to path: a path
+ *     of frag.csv gives frag.<tracenum>.csv. A path ending in .bin is
+ *     written in the binary format, any other path as CSV.
+ */
+void tl_write(timeline_t *tl, char *path, int tracenum)
+{
+    char file[MAXLINE], msg[2*MAXLINE];
+    char *dot, *slash, *suffix;
+    tl_header_t hdr;
+    tl_point_t *p;
+    FILE *out;
+    int binary, i;
+
+    dot = strrchr(path, '.');
+    slash = strrchr(path, '/');
+    if (dot == NULL || (slash != NULL && dot < slash))
+	dot = path + strlen(path);
+    suffix = *dot ? dot : ".csv";
+    binary = strcmp(suffix, ".bin") == 0;
+    snprintf(file, sizeof(file), "%.*s.%d%s",
+	     (int)(dot - path), path, tracenum, suffix);
+
+    if ((out = fopen(file, binary ? "wb" : "w")) == NULL) {
+	sprintf(msg, "Could not create %s in tl_write", file);
+	tl_error(msg);
+    }
+    if (binary) {
+	hdr.magic = TL_MAGIC;
+	hdr.version = TL_VERSION;
+	hdr.num_points = tl->n;
+	hdr.stride = tl->stride;
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1
+	    || fwrite(tl->points, sizeof(tl_point_t), tl->n, out) != tl->n) {
+	    sprintf(msg, "Could not write %s in tl_write", file);
+	    tl_error(msg);
+	}
+    }
+    else {
+	fprintf(out, "op,live_bytes,heap_bytes,free_bytes,chunks\n");
+	for (i = 0; i < tl->n; i++) {
+	    p = &tl->points[i];
+	    fprintf(out, "%lu,%lu,%lu,%lu,%lu\n", (unsigned long)p->op,
+		    (unsigned long)p->live, (unsigned long)p->heap,
+		    (unsigned long)p->free, (unsigned long)p->chunks);
+	}
+    }
+    if (fclose(out) != 0) {
+	sprintf(msg, "Could not write %s in tl_write", file);
+	tl_error(msg);
+    }
+    if (verbose > 1)
+	printf("Wrote %d timeline points (%lu requests each) to %s\n",
+	       tl->n, (unsigned long)tl->stride, file);
+}
+
+/*
+ * tl_free - Free the points of a timeline
+ */
+void tl_free(timeline_t *tl)
+{
+    free(tl->points);
+    tl->points = NULL;
+}
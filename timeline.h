@@ -0,0 +1,54 @@
+#ifndef __TIMELINE_H_
+#define __TIMELINE_H_
+
+/*
+ * timeline.h - fragmentation over the course of a trace
+ *
+ * A timeline samples the live bytes, heap bytes and heap chunks after
+ * the requests of a trace. It holds at most max points: each point
+ * covers stride requests, and when the points run out, neighbouring
+ * points are merged and the stride doubles, so a trace of any length
+ * ends up with between max/2 and max points. Of the requests a point
+ * covers, it keeps the one with the most free heap bytes, so merging
+ * never hides a fragmentation spike.
+ *
+ * Timelines are written as CSV, or in a binary format of one
+ * tl_header_t followed by num_points tl_point_t records.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define TL_MAGIC   0x4c46544d /* "MTFL" */
+#define TL_VERSION 1
+#define TL_POINTS  4096       /* default max points per trace */
+
+typedef struct {
+    uint64_t op;      /* index of the request sampled */
+    uint64_t live;    /* payload bytes allocated after it */
+    uint64_t heap;    /* heap bytes mapped after it */
+    uint64_t free;    /* heap - live */
+    uint64_t chunks;  /* memlib mappings live after it */
+} tl_point_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t num_points;
+    uint64_t stride;  /* requests covered by each point */
+} tl_header_t;
+
+typedef struct {
+    tl_point_t *points;
+    int n;            /* points in use, the last one may be partial */
+    int max;
+    uint64_t stride;
+    uint64_t covered; /* requests covered by the last point so far */
+} timeline_t;
+
+void tl_init(timeline_t *tl, int max);
+void tl_add(timeline_t *tl, uint64_t op, size_t live, size_t heap,
+	    long chunks);
+void tl_write(timeline_t *tl, char *path, int tracenum);
+void tl_free(timeline_t *tl);
+
+#endif /* __TIMELINE_H_ */
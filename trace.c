@@ -0,0 +1,391 @@
+/*
+ * trace.c - read and write the trace files replayed by mdriver
+ *
+ * Text traces (.rep) start with four header lines (suggested heap
+ * size, number of ids, number of ops, weight) followed by one request
+ * per line. Binary traces hold the same header and then fixed-width
+ * traceop_t records, which read_trace uses in place from a read-only
+ * mapping of the file once it has checked that each one is valid.
+ * A trace_reader_t hands out the requests of a text trace one at a
+ * time as they are parsed, for a pass that need not hold them all.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+/* the binary format stores traceop_t as is */
+_Static_assert(sizeof(traceop_t) == 16, "traceop_t must be 16 bytes");
+
+extern int verbose; /* -v option in mdriver.c */
+
+/* A text trace being read one request at a time */
+struct trace_reader {
+    FILE *file;
+    char path[MAXLINE];
+    unsigned tid;        /* thread of the requests being read */
+    int num_ops;         /* requests the header promises */
+    int op_index;        /* requests read so far */
+};
+
+static void read_header(FILE *tracefile, trace_t *trace);
+static int read_op(FILE *tracefile, char *path, unsigned *tid,
+		   traceop_t *op);
+static trace_t *read_trace_bin(trace_t *trace, int fd, char *path);
+static void check_trace_bin(trace_t *trace, char *path);
+static void alloc_blocks(trace_t *trace);
+
+/*
+ * trace_error - Report a Unix-style error and exit
+ */
+static void trace_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    traceop_t op;
+    char path[MAXLINE];
+    char msg[MAXLINE];
+    unsigned tid = 0;
+    unsigned max_index = 0;
+    unsigned op_index;
+    uint32_t magic;
+    int fd;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	trace_error("malloc 1 failed in read_trance");
+    trace->map = NULL;
+    trace->map_len = 0;
+
+    /* Binary traces are recognized by their magic number */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	trace_error(msg);
+    }
+    if (read(fd, &magic, sizeof(magic)) == sizeof(magic)
+	&& magic == TRACE_BIN_MAGIC)
+	return read_trace_bin(trace, fd, path);
+
+    /* Read the trace file header */
+    if ((tracefile = fdopen(fd, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	trace_error(msg);
+    }
+    rewind(tracefile);
+    read_header(tracefile, trace);
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	trace_error("malloc 2 failed in read_trace");
+
+    alloc_blocks(trace);
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    trace->num_threads = 1;
+    while (read_op(tracefile, path, &tid, &op)) {
+	if (op_index >= trace->num_ops) {
+	    printf("Tracefile %s has more than %d requests\n",
+		   path, trace->num_ops);
+	    exit(1);
+	}
+	if (op.type != FREE && op.index > max_index)
+	    max_index = op.index;
+	if (op.tid + 1 > trace->num_threads)
+	    trace->num_threads = op.tid + 1;
+	trace->ops[op_index++] = op;
+    }
+    fclose(tracefile);
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+
+    return trace;
+}
+
+/*
+ * read_header - read the four header lines of a text trace
+ */
+static void read_header(FILE *tracefile, trace_t *trace)
+{
+    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+    fscanf(tracefile, "%d", &(trace->num_ids));
+    fscanf(tracefile, "%d", &(trace->num_ops));
+    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+}
+
+/*
+ * read_op - read the next request of a text trace into op, and return
+ *     0 at the end of the file. A "t <tid>" line sets *tid, the thread
+ *     of the requests after it.
+ */
+static int read_op(FILE *tracefile, char *path, unsigned *tid,
+		   traceop_t *op)
+{
+    char type[MAXLINE];
+    unsigned index, size = 0;
+
+    while (fscanf(tracefile, "%s", type) != EOF) {
+	switch(type[0]) {
+	case 't':
+	    fscanf(tracefile, "%u", tid);
+	    continue;
+	case 'a':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    op->type = ALLOC;
+	    break;
+	case 'r':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    op->type = REALLOC;
+	    break;
+	case 'f':
+	    fscanf(tracefile, "%ud", &index);
+	    op->type = FREE;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n",
+		   type[0], path);
+	    exit(1);
+	}
+	op->index = index;
+	op->size = size;
+	op->tid = *tid;
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ * trace_is_bin - Return true if path holds a binary trace
+ */
+int trace_is_bin(char *path)
+{
+    FILE *f;
+    uint32_t magic = 0;
+
+    if ((f = fopen(path, "rb")) == NULL)
+	return 0;
+    if (fread(&magic, sizeof(magic), 1, f) != 1)
+	magic = 0;
+    fclose(f);
+    return magic == TRACE_BIN_MAGIC;
+}
+
+/*
+ * trace_reader_open - open the text trace at path to be read one
+ *     request at a time, and set *num_ops to its number of requests
+ */
+trace_reader_t *trace_reader_open(char *path, int *num_ops)
+{
+    trace_reader_t *r;
+    trace_t hdr;
+    char msg[MAXLINE];
+
+    if ((r = malloc(sizeof(trace_reader_t))) == NULL)
+	trace_error("malloc failed in trace_reader_open");
+    if ((r->file = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in trace_reader_open", path);
+	trace_error(msg);
+    }
+    strncpy(r->path, path, MAXLINE - 1);
+    r->path[MAXLINE - 1] = '\0';
+    read_header(r->file, &hdr);
+    r->tid = 0;
+    r->num_ops = *num_ops = hdr.num_ops;
+    r->op_index = 0;
+    return r;
+}
+
+/*
+ * trace_reader_next - read the next request into op, and return 0
+ *     once every request has been read
+ */
+int trace_reader_next(trace_reader_t *r, traceop_t *op)
+{
+    if (!read_op(r->file, r->path, &r->tid, op)) {
+	if (r->op_index != r->num_ops) {
+	    printf("Tracefile %s has %d requests, not %d\n",
+		   r->path, r->op_index, r->num_ops);
+	    exit(1);
+	}
+	return 0;
+    }
+    if (r->op_index++ >= r->num_ops) {
+	printf("Tracefile %s has more than %d requests\n",
+	       r->path, r->num_ops);
+	exit(1);
+    }
+    return 1;
+}
+
+/*
+ * trace_reader_close - close a trace opened by trace_reader_open
+ */
+void trace_reader_close(trace_reader_t *r)
+{
+    fclose(r->file);
+    free(r);
+}
+
+/*
+ * read_trace_bin - map the binary trace file open on fd and use its
+ *     records as the trace's request array
+ */
+static trace_t *read_trace_bin(trace_t *trace, int fd, char *path)
+{
+    trace_bin_header_t *hdr;
+    struct stat st;
+    char msg[MAXLINE];
+
+    if (fstat(fd, &st) < 0)
+	trace_error("fstat failed in read_trace");
+    if (st.st_size < sizeof(trace_bin_header_t)) {
+	printf("Truncated binary tracefile %s\n", path);
+	exit(1);
+    }
+
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in read_trace", path);
+	trace_error(msg);
+    }
+    close(fd);
+    madvise(trace->map, trace->map_len, MADV_SEQUENTIAL);
+
+    hdr = (trace_bin_header_t *)trace->map;
+    if (hdr->version != TRACE_BIN_VERSION) {
+	printf("Binary tracefile %s has version %u, expected %u\n",
+	       path, hdr->version, TRACE_BIN_VERSION);
+	exit(1);
+    }
+    if (hdr->num_ops < 0 || hdr->num_ids < 0
+	|| trace->map_len != sizeof(trace_bin_header_t)
+	+ (size_t)hdr->num_ops * sizeof(traceop_t)) {
+	printf("Binary tracefile %s does not hold %d requests\n",
+	       path, hdr->num_ops);
+	exit(1);
+    }
+
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->num_threads = hdr->num_threads;
+    trace->ops = (traceop_t *)(hdr + 1);
+    if (trace->num_threads < 1) {
+	printf("Binary tracefile %s has %d threads\n",
+	       path, trace->num_threads);
+	exit(1);
+    }
+    check_trace_bin(trace, path);
+
+    alloc_blocks(trace);
+    return trace;
+}
+
+/*
+ * check_trace_bin - Make sure that every request of a mapped binary
+ *     trace is one the driver can replay, as parsing a text trace
+ *     does, so that a damaged file cannot send it out of bounds
+ */
+static void check_trace_bin(trace_t *trace, char *path)
+{
+    traceop_t *op;
+    int i;
+
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	if ((unsigned)op->type > REALLOC
+	    || op->index < 0 || op->index >= trace->num_ids
+	    || (op->type != FREE && op->size < 0)
+	    || op->tid < 0 || op->tid >= trace->num_threads) {
+	    printf("Bogus request %d in binary tracefile %s\n", i, path);
+	    exit(1);
+	}
+    }
+}
+
+/*
+ * alloc_blocks - allocate the arrays that remember each id's block
+ */
+static void alloc_blocks(trace_t *trace)
+{
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	trace_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	trace_error("malloc 4 failed in read_trace");
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    if (trace->map)           /* the requests live in the mapping... */
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);     /* ... or in their own array */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * write_trace_bin - write trace to path in the binary format
+ */
+void write_trace_bin(trace_t *trace, char *path)
+{
+    trace_bin_header_t hdr;
+    FILE *out;
+    char msg[MAXLINE];
+
+    hdr.magic = TRACE_BIN_MAGIC;
+    hdr.version = TRACE_BIN_VERSION;
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+    hdr.num_threads = trace->num_threads;
+
+    if ((out = fopen(path, "wb")) == NULL) {
+	sprintf(msg, "Could not create %s in write_trace_bin", path);
+	trace_error(msg);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1
+	|| fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, out)
+	   != trace->num_ops
+	|| fclose(out) != 0) {
+	sprintf(msg, "Could not write %s in write_trace_bin", path);
+	trace_error(msg);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+/*
+ * trace.h - reading and writing the trace files replayed by mdriver
+ *
+ * A trace is either the original text format (.rep), parsed line by
+ * line, or the binary format written by write_trace_bin, which
+ * read_trace maps into memory and replays in place. Nothing is parsed,
+ * but read_trace reads every record once to check it, so the whole
+ * file is paged in before the first request.
+ * read_trace tells them apart by the binary format's magic number.
+ * A pass over a text trace that does not need it all in memory, like
+ * the profile of -A, reads it with trace_reader_next instead.
+ *
+ * In a text trace, a line "t <tid>" says that the requests after it
+ * were made by thread tid; a trace without such lines has only
+ * thread 0.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    int tid;                          /* thread that made the request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    int num_threads;     /* 1 + the largest thread id of a request */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping of a binary trace file, or NULL */
+    size_t map_len;      /* ... and its length */
+} trace_t;
+
+/* 
+ * Header of a binary trace file. It is followed directly by num_ops
+ * traceop_t records in host byte order, so the file can only be read
+ * on the kind of machine that wrote it; the magic number catches
+ * files with the wrong byte order.
+ */
+#define TRACE_BIN_MAGIC   0x4352544d /* "MTRC" */
+#define TRACE_BIN_VERSION 2  /* 2 added traceop_t.tid and num_threads */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t sugg_heapsize;
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+    int32_t num_threads;
+} trace_bin_header_t;
+
+/* A text trace read one request at a time */
+typedef struct trace_reader trace_reader_t;
+
+trace_t *read_trace(char *tracedir, char *filename);
+void free_trace(trace_t *trace);
+void write_trace_bin(trace_t *trace, char *path);
+int trace_is_bin(char *path);
+trace_reader_t *trace_reader_open(char *path, int *num_ops);
+int trace_reader_next(trace_reader_t *r, traceop_t *op);
+void trace_reader_close(trace_reader_t *r);
+
+#endif /* __TRACE_H_ */
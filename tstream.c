@@ -0,0 +1,416 @@
+/*
+ * tstream.c - write compressed stream traces and replay them in chunks
+ *
+ * The reader starts a decoder thread that fills a ring of
+ * TSTREAM_SLOTS decoded chunks. tstream_next hands the oldest decoded
+ * chunk to the caller and, on the following call, gives its slot back
+ * to the decoder, so decoding overlaps with replay and memory use is
+ * bounded no matter how long the trace is.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "tstream.h"
+
+#define MAXLINE 1024 /* max string size */
+
+/* most bytes one encoded request can take: two 10-byte varints */
+#define MAX_OP_BYTES 20
+
+struct tstream {
+    FILE *file;
+    char path[MAXLINE];
+    tstream_header_t hdr;
+    pthread_t decoder;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;     /* a slot was decoded, or the file ended */
+    pthread_cond_t emptied;    /* the replay gave a slot back */
+    tstream_op_t *slots[TSTREAM_SLOTS];
+    int counts[TSTREAM_SLOTS]; /* requests held by each slot */
+    uint64_t head;             /* chunks decoded so far */
+    uint64_t tail;             /* chunks given back so far */
+    int held;                  /* the replay holds slot tail */
+    int done;                  /* the decoder reached the end of the file */
+    int stop;                  /* the decoder should quit early */
+    unsigned char *buf;        /* encoded bytes of the current chunk */
+    size_t buf_size;
+};
+
+struct tstream_writer {
+    FILE *file;
+    char path[MAXLINE];
+    tstream_header_t hdr;
+    unsigned char *buf;        /* the chunk being encoded */
+    size_t len;                /* bytes of it used */
+    uint32_t num_ops;          /* requests in it */
+    uint64_t prev;             /* index of its last request */
+};
+
+/*
+ * stream_error - Report a Unix-style error and exit
+ */
+static void stream_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * corrupt - Report a malformed stream trace and exit
+ */
+static void corrupt(tstream_t *s, char *what)
+{
+    printf("Corrupt stream tracefile %s: %s\n", s->path, what);
+    exit(1);
+}
+
+/*********************************************************
+ * Reading
+ ********************************************************/
+
+/*
+ * tstream_is_stream - Return true if path holds a stream trace
+ */
+int tstream_is_stream(char *path)
+{
+    FILE *f;
+    uint32_t magic = 0;
+
+    if ((f = fopen(path, "rb")) == NULL)
+	return 0;
+    if (fread(&magic, sizeof(magic), 1, f) != 1)
+	magic = 0;
+    fclose(f);
+    return magic == TSTREAM_MAGIC;
+}
+
+/*
+ * get_varint - Decode the varint at *pp, which must end before end
+ */
+static uint64_t get_varint(tstream_t *s, unsigned char **pp, unsigned char *end)
+{
+    unsigned char *p = *pp;
+    uint64_t v = 0;
+    int shift = 0;
+
+    do {
+	if (p == end || shift > 63)
+	    corrupt(s, "truncated request");
+	v |= (uint64_t)(*p & 0x7f) << shift;
+	shift += 7;
+    } while (*p++ & 0x80);
+    *pp = p;
+    return v;
+}
+
+/*
+ * decode_chunk - Decode the n requests in s->buf into ops
+ */
+static void decode_chunk(tstream_t *s, size_t len, int n, tstream_op_t *ops)
+{
+    unsigned char *p = s->buf, *end = s->buf + len;
+    uint64_t prev = 0, v, zz;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	v = get_varint(s, &p, end);
+	zz = v >> 2;
+	ops[i].type = v & 3;
+	ops[i].index = prev + (uint64_t)((zz >> 1) ^ -(zz & 1));
+	prev = ops[i].index;
+	switch (ops[i].type) {
+	case ALLOC:
+	case REALLOC:
+	    ops[i].size = get_varint(s, &p, end);
+	    break;
+	case FREE:
+	    ops[i].size = 0;
+	    break;
+	default:
+	    corrupt(s, "bogus request type");
+	}
+	if (ops[i].index >= s->hdr.num_ids)
+	    corrupt(s, "request index out of range");
+    }
+    if (p != end)
+	corrupt(s, "chunk longer than its requests");
+}
+
+/*
+ * decoder - Body of the decoder thread
+ */
+static void *decoder(void *arg)
+{
+    tstream_t *s = (tstream_t *)arg;
+    uint32_t chunk[2]; /* number of requests, number of bytes */
+    uint64_t total = 0;
+    int slot;
+
+    while (fread(chunk, sizeof(chunk), 1, s->file) == 1) {
+	if (chunk[0] > TSTREAM_CHUNK_OPS)
+	    corrupt(s, "chunk holds too many requests");
+	if (chunk[1] > s->buf_size) {
+	    s->buf_size = chunk[1];
+	    if ((s->buf = realloc(s->buf, s->buf_size)) == NULL)
+		stream_error("realloc failed in tstream decoder");
+	}
+	if (fread(s->buf, 1, chunk[1], s->file) != chunk[1])
+	    corrupt(s, "truncated chunk");
+
+	/* Wait for a free slot */
+	pthread_mutex_lock(&s->lock);
+	while (s->head - s->tail == TSTREAM_SLOTS && !s->stop)
+	    pthread_cond_wait(&s->emptied, &s->lock);
+	if (s->stop) {
+	    pthread_mutex_unlock(&s->lock);
+	    return NULL;
+	}
+	slot = s->head % TSTREAM_SLOTS;
+	pthread_mutex_unlock(&s->lock);
+
+	/* The replay can't see the slot until head moves past it */
+	decode_chunk(s, chunk[1], chunk[0], s->slots[slot]);
+	total += chunk[0];
+
+	pthread_mutex_lock(&s->lock);
+	s->counts[slot] = chunk[0];
+	s->head++;
+	pthread_cond_signal(&s->filled);
+	pthread_mutex_unlock(&s->lock);
+    }
+
+    if (total != s->hdr.num_ops)
+	corrupt(s, "number of requests does not match the header");
+
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    pthread_cond_signal(&s->filled);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/*
+ * tstream_open - Open the stream trace at path and start decoding it
+ */
+tstream_t *tstream_open(char *path)
+{
+    tstream_t *s;
+    char msg[MAXLINE];
+    int i;
+
+    if ((s = (tstream_t *)calloc(1, sizeof(tstream_t))) == NULL)
+	stream_error("calloc failed in tstream_open");
+    strncpy(s->path, path, MAXLINE-1);
+
+    if ((s->file = fopen(path, "rb")) == NULL) {
+	sprintf(msg, "Could not open %s in tstream_open", path);
+	stream_error(msg);
+    }
+    if (fread(&s->hdr, sizeof(s->hdr), 1, s->file) != 1
+	|| s->hdr.magic != TSTREAM_MAGIC)
+	corrupt(s, "bad header");
+    if (s->hdr.version != TSTREAM_VERSION)
+	corrupt(s, "unsupported version");
+
+    for (i = 0; i < TSTREAM_SLOTS; i++)
+	if ((s->slots[i] = malloc(TSTREAM_CHUNK_OPS * sizeof(tstream_op_t))) == NULL)
+	    stream_error("malloc failed in tstream_open");
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->filled, NULL);
+    pthread_cond_init(&s->emptied, NULL);
+    if ((errno = pthread_create(&s->decoder, NULL, decoder, s)) != 0)
+	stream_error("pthread_create failed in tstream_open");
+    return s;
+}
+
+/*
+ * tstream_header - Return the header of an open stream trace
+ */
+tstream_header_t *tstream_header(tstream_t *s)
+{
+    return &s->hdr;
+}
+
+/*
+ * tstream_next - Give back the chunk returned by the previous call and
+ *     point *ops at the next one. Returns the number of requests in
+ *     it, or 0 at the end of the trace.
+ */
+int tstream_next(tstream_t *s, tstream_op_t **ops)
+{
+    int n;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->held) {
+	s->tail++;
+	s->held = 0;
+	pthread_cond_signal(&s->emptied);
+    }
+    while (s->head == s->tail && !s->done)
+	pthread_cond_wait(&s->filled, &s->lock);
+    if (s->head == s->tail) {
+	pthread_mutex_unlock(&s->lock);
+	return 0;
+    }
+    s->held = 1;
+    n = s->counts[s->tail % TSTREAM_SLOTS];
+    *ops = s->slots[s->tail % TSTREAM_SLOTS];
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+/*
+ * tstream_close - Stop decoding and free the stream
+ */
+void tstream_close(tstream_t *s)
+{
+    int i;
+
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_signal(&s->emptied);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->decoder, NULL);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->filled);
+    pthread_cond_destroy(&s->emptied);
+    for (i = 0; i < TSTREAM_SLOTS; i++)
+	free(s->slots[i]);
+    free(s->buf);
+    fclose(s->file);
+    free(s);
+}
+
+/*********************************************************
+ * Writing
+ ********************************************************/
+
+/*
+ * put_varint - Append v to the chunk being encoded
+ */
+static void put_varint(tstream_writer_t *w, uint64_t v)
+{
+    while (v >= 0x80) {
+	w->buf[w->len++] = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    w->buf[w->len++] = v;
+}
+
+/*
+ * flush_chunk - Write out the chunk being encoded and start a new one
+ */
+static void flush_chunk(tstream_writer_t *w)
+{
+    uint32_t chunk[2];
+    char msg[2*MAXLINE];
+
+    if (w->num_ops == 0)
+	return;
+    chunk[0] = w->num_ops;
+    chunk[1] = w->len;
+    if (fwrite(chunk, sizeof(chunk), 1, w->file) != 1
+	|| fwrite(w->buf, 1, w->len, w->file) != w->len) {
+	sprintf(msg, "Could not write %s in tstream_put", w->path);
+	stream_error(msg);
+    }
+    w->len = 0;
+    w->num_ops = 0;
+    w->prev = 0;
+}
+
+/*
+ * tstream_create - Start writing a stream trace to path
+ */
+tstream_writer_t *tstream_create(char *path, int sugg_heapsize, int weight)
+{
+    tstream_writer_t *w;
+    char msg[MAXLINE];
+
+    if ((w = (tstream_writer_t *)calloc(1, sizeof(tstream_writer_t))) == NULL)
+	stream_error("calloc failed in tstream_create");
+    if ((w->buf = malloc(TSTREAM_CHUNK_OPS * MAX_OP_BYTES)) == NULL)
+	stream_error("malloc failed in tstream_create");
+    strncpy(w->path, path, MAXLINE-1);
+
+    w->hdr.magic = TSTREAM_MAGIC;
+    w->hdr.version = TSTREAM_VERSION;
+    w->hdr.sugg_heapsize = sugg_heapsize;
+    w->hdr.weight = weight;
+
+    /* The header is written again with the final counts by tstream_finish */
+    if ((w->file = fopen(path, "wb")) == NULL
+	|| fwrite(&w->hdr, sizeof(w->hdr), 1, w->file) != 1) {
+	sprintf(msg, "Could not create %s in tstream_create", path);
+	stream_error(msg);
+    }
+    return w;
+}
+
+/*
+ * tstream_put - Append one request to a stream trace
+ */
+void tstream_put(tstream_writer_t *w, int type, uint64_t index, uint32_t size)
+{
+    int64_t delta;
+    uint64_t zz;
+
+    if (w->num_ops == TSTREAM_CHUNK_OPS)
+	flush_chunk(w);
+
+    delta = (int64_t)(index - w->prev);
+    zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    put_varint(w, (zz << 2) | type);
+    if (type != FREE)
+	put_varint(w, size);
+    w->prev = index;
+    w->num_ops++;
+
+    w->hdr.num_ops++;
+    if (index >= w->hdr.num_ids)
+	w->hdr.num_ids = index + 1;
+}
+
+/*
+ * tstream_finish - Write the last chunk and the final header, and
+ *     free the writer
+ */
+void tstream_finish(tstream_writer_t *w)
+{
+    char msg[2*MAXLINE];
+
+    flush_chunk(w);
+    if (fseek(w->file, 0, SEEK_SET) != 0
+	|| fwrite(&w->hdr, sizeof(w->hdr), 1, w->file) != 1
+	|| fclose(w->file) != 0) {
+	sprintf(msg, "Could not write %s in tstream_finish", w->path);
+	stream_error(msg);
+    }
+    free(w->buf);
+    free(w);
+}
+
+/*
+ * write_trace_stream - Write a trace held in memory as a stream trace
+ */
+void write_trace_stream(trace_t *trace, char *path)
+{
+    tstream_writer_t *w;
+    int i;
+
+    if (trace->num_threads > 1) {
+	printf("Stream traces hold a single thread; cannot write %d to %s\n",
+	       trace->num_threads, path);
+	exit(1);
+    }
+    w = tstream_create(path, trace->sugg_heapsize, trace->weight);
+    for (i = 0; i < trace->num_ops; i++)
+	tstream_put(w, trace->ops[i].type, trace->ops[i].index,
+		    trace->ops[i].size);
+    tstream_finish(w);
+}
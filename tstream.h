@@ -0,0 +1,59 @@
+#ifndef __TSTREAM_H_
+#define __TSTREAM_H_
+
+/*
+ * tstream.h - compressed trace files that are replayed as a stream
+ *
+ * A stream trace is too large to load with read_trace, so it is
+ * decoded a chunk at a time by a background thread into a small ring
+ * of buffers while the driver replays the chunks already decoded.
+ *
+ * After the header, the file is a sequence of chunks. Each chunk
+ * starts with its number of requests and its length in bytes, then
+ * holds the requests, each encoded as
+ *     varint((zigzag(index - previous index) << 2) | type)
+ *     varint(size)                    (allocs and reallocs only)
+ * The previous index starts at 0 in every chunk, so chunks decode
+ * independently of each other.
+ */
+#include <stdint.h>
+#include "trace.h"
+
+#define TSTREAM_MAGIC     0x5a52544d /* "MTRZ" */
+#define TSTREAM_VERSION   1
+#define TSTREAM_CHUNK_OPS 65536      /* max requests per chunk */
+#define TSTREAM_SLOTS     8          /* decoded chunks buffered ahead */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t sugg_heapsize;   /* suggested heap size (unused) */
+    int32_t weight;          /* weight for this trace (unused) */
+    uint64_t num_ids;        /* number of alloc/realloc ids */
+    uint64_t num_ops;        /* number of requests */
+} tstream_header_t;
+
+/* One decoded request; type is ALLOC, FREE or REALLOC from trace.h */
+typedef struct {
+    int type;
+    uint32_t size;
+    uint64_t index;
+} tstream_op_t;
+
+typedef struct tstream tstream_t;
+typedef struct tstream_writer tstream_writer_t;
+
+/* Reading */
+int tstream_is_stream(char *path);
+tstream_t *tstream_open(char *path);
+tstream_header_t *tstream_header(tstream_t *s);
+int tstream_next(tstream_t *s, tstream_op_t **ops);
+void tstream_close(tstream_t *s);
+
+/* Writing */
+tstream_writer_t *tstream_create(char *path, int sugg_heapsize, int weight);
+void tstream_put(tstream_writer_t *w, int type, uint64_t index, uint32_t size);
+void tstream_finish(tstream_writer_t *w);
+void write_trace_stream(trace_t *trace, char *path);
+
+#endif /* __TSTREAM_H_ */